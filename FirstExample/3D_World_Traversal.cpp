@@ -5,11 +5,15 @@
 //
 ////////////////////////////////////////////////////////////////////////////////////
 
-#include <windows.networking.h>
-#pragma comment(lib, "Ws2_32.lib")
+#include "Socket.h"
 #include <iostream>
 #include <vector>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <memory>
 #include "vgl.h"
 #include "LoadShaders.h"
 #include "glm\glm.hpp"
@@ -18,49 +22,58 @@
 #include "..\SOIL\src\SOIL.h"
 #include "Player.h"
 #include "PlayerSerializer.h"
+#include "GameClient.h"
+#include "FixedTimestep.h"
+#include "Frustum.h"
+#include "MeshRegistry.h"
+#include "PlayerIndex.h"
+#include "RemotePlayers.h"
+#include "RenderSnapshot.h"
+#include "SceneStore.h"
+#include "SnapshotInterpolator.h"
+#include "SpatialHash.h"
+#include "SpscQueue.h"
+#include "TextureStreamer.h"
+#include "TripleBuffer.h"
 
 using namespace sdds;
 
-//Added on Nov. 21 2021 by: Alireza Moghaddam
-enum GameObject_Type {
-	PLAYER,
-	ENEMY,
-	BULLET,
-	OBSTACLE
-};
-
-struct GameObject {
-
-	glm::vec3 location{};
-	glm::vec3 rotation{};
-	glm::vec3 scale{};
-	glm::vec3 moving_direction{};
-	GLfloat velocity{};
-	GLfloat collider_dimension{}; //We use box as wrapper with radius = 0.9 * scale of the object Note: 0.9 is the original dimension of the boxes we generate
-	int living_time{};
-	int life_span{};		//In this code, the life span for obstacles is set to a negative value (Just so that they remain in the scene during the game)
-	int type{};
-	bool isAlive{};
-	bool isCollided{};
-
-};
-//End of fragment added
 
 enum VAO_IDs { Triangles, NumVAOs };
-enum Buffer_IDs { ArrayBuffer};
-enum Attrib_IDs { vPosition = 0 };
+enum Buffer_IDs { InstanceBuffer };
+enum Attrib_IDs { vPosition = 0, vTexCoord = 1, vInstanceOffset = 2, vInstanceScale = 3 };
 
-const GLint NumBuffers = 2;
+const GLint NumBuffers = 1;	//Per-instance data. Static meshes live in the MeshRegistry.
 GLuint VAOs[NumVAOs];
 GLuint Buffers[NumBuffers];
 GLuint location;
 GLuint cam_mat_location;
 GLuint proj_mat_location;
 GLuint texture[2];	//Array of pointers to textrure data in VRAM. We use two textures in this example.
+std::unique_ptr<TextureStreamer> texture_streamer;	//Fills texture[] in the background, pumped once a frame by display()
+
+//Per-instance data for the instanced cube path. One entry per live object, streamed into the instance buffer every frame.
+struct CubeInstance {
+	glm::vec3 offset;
+	glm::vec3 scale;
+};
+std::vector<CubeInstance> cube_instances[2];	//One batch per texture, indexed like texture[]
+
+//CPU side frustum culling: objects outside the camera frustum never reach the GL
+Frustum view_frustum;					//Extracted from proj_matrix * camera_matrix in display()
+std::vector<uint8_t> visible_objects;	//Per scene object, written by cullSpheres()
+CullStats cull_stats;					//Live objects drawn/culled during the last frame
+
+size_t static_mesh_uploads = 0;	//MeshRegistry::uploadCount() at the end of init(). Must not change afterwards.
 
 
 const GLuint NumVertices = 28;
 
+//Index ranges inside the element buffer of the level mesh. Every quad is a triangle strip (see MeshRegistry::quadStrips).
+const GLsizei GroundIndexCount = 4;			//1 quad
+const GLsizei CubeFirstIndex = GroundIndexCount;
+const GLsizei CubeIndexCount = 6 * 5 - 1;	//6 quads separated by 5 restart indices
+
 //Height of camera (player) from the level
 float height = 0.8f;
 
@@ -88,14 +101,31 @@ glm::vec3 side_vector = glm::cross(up_vector, forward_vector);
 int oldTimeSinceStart = 0;
 int deltaTime;
 
+//The simulation runs at a fixed 120 Hz on its own thread, independent of the frame rate.
+//After every step it publishes a RenderSnapshot through a triple buffer; rendering reads the latest one without
+//locking and interpolates between its last two states.
+FixedTimestep simulation_clock(1000.0 / 120.0);
+std::thread simulation_thread;
+std::atomic<bool> simulation_running{ false };
+TripleBuffer<RenderSnapshot> render_snapshots;
+double simulation_busy_ms = 0;	//Time spent inside updateSceneGraph(), simulation thread only
+
+//Objects requested by the GLUT thread (e.g. fired bullets), spawned by the simulation thread at its next step
+std::mutex spawn_mutex;
+std::vector<GameObject> pending_spawns;
+
 //Creating and rendering bunch of objects on the scene to interact with
 const int Num_Obstacles = 1;
 float obstacle_data[Num_Obstacles][3];
-std::vector<GameObject> sceneGraph;
+SceneStore sceneGraph;	//Owned by the simulation thread once it is started
+
+//Broad phase used by checkCollisions(). Cells are 2x2 units, which is about the size of a small obstacle.
+SpatialHash collisionGrid(2.0f);
 
 void addPlayer(float x, float y);
 void refresh_screen();
 void networkInitialize();
+void startSimulation();
 
 //Helper function to generate a random float number within a range
 float randomFloat(float a, float b)
@@ -106,16 +136,12 @@ float randomFloat(float a, float b)
 	return a + r;
 }
 
-// inititializing buffers, coordinates, setting up pipeline, etc.
-void init(void)
+//Creates the simulated part of the level. Needs no GL, so it is shared by init() and the headless mode.
+void initScene(void)
 {
-	glEnable(GL_DEPTH_TEST);
-
-	//Normalizing all vectors
-	up_vector = glm::normalize(up_vector);
-	forward_vector = glm::normalize(forward_vector);
-	looking_dir_vector = glm::normalize(looking_dir_vector);
-	side_vector = glm::normalize(side_vector);
+	const char* integrator_name = nullptr;
+	selectIntegrator(&integrator_name);
+	std::cout << "Scene integrator: " << integrator_name << std::endl;
 
 	//Modified on Nov. 21 2021 by: Alireza Moghaddam
 
@@ -139,10 +165,25 @@ void init(void)
 		go.type = OBSTACLE;
 		go.moving_direction = glm::vec3(0, 0, 0);
 		go.life_span = -1;
-		sceneGraph.push_back(go);
+		sceneGraph.spawn(go);
 		
 	}
 	//End of modification
+}
+
+// inititializing buffers, coordinates, setting up pipeline, etc.
+void init(void)
+{
+	glEnable(GL_DEPTH_TEST);
+
+	//Normalizing all vectors
+	up_vector = glm::normalize(up_vector);
+	forward_vector = glm::normalize(forward_vector);
+	looking_dir_vector = glm::normalize(looking_dir_vector);
+	side_vector = glm::normalize(side_vector);
+
+	initScene();
+	startSimulation();
 
 	ShaderInfo shaders[] = {
 		{ GL_VERTEX_SHADER, "triangles.vert" },
@@ -238,24 +279,31 @@ void init(void)
 	//Creating our texture:
 	//This texture is loaded from file. To do this, we use the SOIL (Simple OpenGL Imaging Library) library.
 	//When using the SOIL_load_image() function, make sure the you are using correct patrameters, or else, your image will NOT be loaded properly, or will not be loaded at all.
-	GLint width1, height1;
-	unsigned char* textureData1 = SOIL_load_image("grass.png", &width1, &height1, 0, SOIL_LOAD_RGB);
-
-	GLint width2, height2;
-	unsigned char* textureData2 = SOIL_load_image("apple.png", &width2, &height2, 0, SOIL_LOAD_RGB);
-
-	glGenBuffers(2, Buffers);
-	glBindBuffer(GL_ARRAY_BUFFER, Buffers[0]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-	glBindAttribLocation(program, 0, "vPosition");
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
-	glEnableVertexAttribArray(0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, Buffers[1]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(textureCoordinates), textureCoordinates, GL_STATIC_DRAW);
-	glBindAttribLocation(program, 1, "vTexCoord");
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
-	glEnableVertexAttribArray(1);
+	//The files are decoded on worker threads and streamed into texture[] while the game runs; see the TEXTURE SET UP
+	//section below.
+	texture_streamer.reset(new TextureStreamer(SOIL_load_image, SOIL_free_image_data));
+
+	//The quads are drawn as indexed triangle strips, one per face, separated by the primitive restart index.
+	//The cube keeps 4 vertices per face because every face needs its own texture coordinates.
+	std::vector<GLushort> indices = MeshRegistry::quadStrips(0, 1);	//Ground
+	std::vector<GLushort> cube_indices = MeshRegistry::quadStrips(4, 6);
+	indices.insert(indices.end(), cube_indices.begin(), cube_indices.end());
+
+	glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+
+	//The level mesh is uploaded once into its own VAO; drawing only binds it
+	MeshRegistry::add(MeshID::level, vertices, textureCoordinates, NumVertices, indices.data(), (GLsizei)indices.size());
+
+	//Instance attributes, recorded into the level VAO. Their arrays are only enabled while an instanced batch is
+	//drawn; every other draw uses the constant values below, which leave the geometry where it is (no offset, unit scale).
+	glGenBuffers(NumBuffers, Buffers);
+	glBindBuffer(GL_ARRAY_BUFFER, Buffers[InstanceBuffer]);
+	glVertexAttribPointer(vInstanceOffset, 3, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), BUFFER_OFFSET(offsetof(CubeInstance, offset)));
+	glVertexAttribPointer(vInstanceScale, 3, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), BUFFER_OFFSET(offsetof(CubeInstance, scale)));
+	glVertexAttribDivisor(vInstanceOffset, 1);
+	glVertexAttribDivisor(vInstanceScale, 1);
+	glVertexAttrib3f(vInstanceOffset, 0.0f, 0.0f, 0.0f);
+	glVertexAttrib3f(vInstanceScale, 1.0f, 1.0f, 1.0f);
 
 	location = glGetUniformLocation(program, "model_matrix");
 	cam_mat_location = glGetUniformLocation(program, "camera_matrix");
@@ -266,37 +314,30 @@ void init(void)
 	//Allocating two buffers in VRAM
 	glGenTextures(2, texture);
 
-	//First Texture: 
-
-	//Set the type of the allocated buffer as "TEXTURE_2D"
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
-
-	//Loading the second texture into the second allocated buffer:
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width1, height1, 0, GL_RGB, GL_UNSIGNED_BYTE, textureData1);
-
-	//Setting up parameters for the texture that recently pushed into VRAM
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-
-	//And now, second texture: 
-
-	//Set the type of the allocated buffer as "TEXTURE_2D"
-	glBindTexture(GL_TEXTURE_2D, texture[1]);
-
-	//Loading the second texture into the second allocated buffer:
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width2, height2, 0, GL_RGB, GL_UNSIGNED_BYTE, textureData2);
+	//Until its file arrives every texture holds one grey texel, so the level can be drawn right away
+	const GLubyte placeholder[3] = { 128, 128, 128 };
+	for (GLuint t : texture) {
+		//Set the type of the allocated buffer as "TEXTURE_2D"
+		glBindTexture(GL_TEXTURE_2D, t);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, placeholder);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		//Setting up parameters for the texture; they stay when the real image replaces the placeholder
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	}
 
-	//Setting up parameters for the texture that recently pushed into VRAM
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	//Each file goes through the pixel buffer ring into its texture as soon as it is decoded
+	texture_streamer->stream("grass.png", texture[0], SOIL_LOAD_RGB);
+	texture_streamer->stream("apple.png", texture[1], SOIL_LOAD_RGB);
 	//////////////////////////////////////////////////////////////
 
 
+	static_mesh_uploads = MeshRegistry::uploadCount();
+
 	//Initlializing Network Components:
 	networkInitialize();
 }
@@ -310,84 +351,94 @@ void drawCube(glm::vec3 scale)
 
 	//Select the second texture (apple.png) when drawing the second geometry (cube)
 	glBindTexture(GL_TEXTURE_2D, texture[1]);
-	glDrawArrays(GL_QUADS, 4, 24);
+	glDrawElements(GL_TRIANGLE_STRIP, CubeIndexCount, GL_UNSIGNED_SHORT, BUFFER_OFFSET(CubeFirstIndex * sizeof(GLushort)));
 }
 //End of Modification
 
+//Draws every cube of a batch with a single call. The instance data is streamed into the instance buffer; the buffer is
+//orphaned first so the driver does not have to wait for the previous frame to finish reading it.
+void drawCubesInstanced(const std::vector<CubeInstance>& instances, GLuint tex)
+{
+	if (instances.empty())
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, Buffers[InstanceBuffer]);
+	glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(CubeInstance), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(CubeInstance), instances.data());
+
+	model_view = glm::mat4(1.0);
+	glUniformMatrix4fv(location, 1, GL_FALSE, &model_view[0][0]);
+	glBindTexture(GL_TEXTURE_2D, tex);
+
+	glEnableVertexAttribArray(vInstanceOffset);
+	glEnableVertexAttribArray(vInstanceScale);
+	glDrawElementsInstanced(GL_TRIANGLE_STRIP, CubeIndexCount, GL_UNSIGNED_SHORT, BUFFER_OFFSET(CubeFirstIndex * sizeof(GLushort)), (GLsizei)instances.size());
+	glDisableVertexAttribArray(vInstanceOffset);
+	glDisableVertexAttribArray(vInstanceScale);
+
+	//Back to the constant "no instancing" values for the non-instanced draws
+	glVertexAttrib3f(vInstanceOffset, 0.0f, 0.0f, 0.0f);
+	glVertexAttrib3f(vInstanceScale, 1.0f, 1.0f, 1.0f);
+}
+
 //Added on Nov. 21 2021 by: Alireza Moghaddam
 
-//This function takes in two game objects and finds out if they are colliding.
-bool isColliding(GameObject one, GameObject two) {
+//This function takes in two game objects (by their index in the scene) and finds out if they are colliding.
+bool isColliding(uint32_t one, uint32_t two) {
 	bool result = false;
 	
-	std::cout << one.scale.x << ", " << one.collider_dimension << ", " << two.scale.x << ", " << two.collider_dimension << std::endl;
-	std::cout << glm::abs(one.location.x - two.location.x) << ", " << glm::abs(one.location.y - two.location.x) << std::endl;
+	//std::cout << sceneGraph.scale[one].x << ", " << sceneGraph.collider_dimension[one] << ", " << sceneGraph.scale[two].x << ", " << sceneGraph.collider_dimension[two] << std::endl;
 
-	bool cond = glm::abs(one.location.x - two.location.x) <= (one.collider_dimension/2 + two.collider_dimension/2) &&
-				glm::abs(one.location.y - two.location.y) <= (one.collider_dimension/2 + two.collider_dimension/2);
+	float reach = sceneGraph.collider_dimension[one] / 2 + sceneGraph.collider_dimension[two] / 2;
+	bool cond = glm::abs(sceneGraph.location_x[one] - sceneGraph.location_x[two]) <= reach &&
+				glm::abs(sceneGraph.location_y[one] - sceneGraph.location_y[two]) <= reach;
 
 	if (cond) {
-		//cout << one.type << " has collided with" << two.type << endl;
-		//cout << one.location.x << ", " << one.location.y << ", " << one.location.z << endl;
+		//cout << sceneGraph.type[one] << " has collided with" << sceneGraph.type[two] << endl;
 		result = true;
 	}
 	return result;
 }
 
 
-//This function iterates through the scene graph and checks the collision status between each and every two objects
-//When collided, the .isCollided property of the game object is set to true
+//This function checks the collision status between every two objects that are close enough to possibly collide
+//When collided, the collided flag of the game object is set
 void checkCollisions() {
 
-	for (int i = 0u; i < sceneGraph.size(); i++) {
-		for (int j = 0u; j < sceneGraph.size(); j++) {
-			if (i != j && /*if i=j then it means that we are checking self-collilsion. We do NOT consider self-collision as a collision*/
-				sceneGraph[i].isAlive && 
-				sceneGraph[j].isAlive && 
-				!(sceneGraph[i].type == OBSTACLE && sceneGraph[j].type == OBSTACLE) && //We ignore the collision between two obstacles :-)
-				isColliding(sceneGraph[i], sceneGraph[j])) {	
-				
-				//if(!(sceneGraph[i].type == OBSTACLE && sceneGraph[j].type == OBSTACLE))	//We ignore the collision between two obstacles :-)
-				//{
-					sceneGraph[i].isCollided = true;
-					sceneGraph[j].isCollided = true;
-					//cout << sceneGraph[i].type << " has collided with" << sceneGraph[j].type << endl;
-					//cout << sceneGraph[i].location.x << ", " << sceneGraph[i].location.y << ", " << sceneGraph[i].location.z << endl;
-				//}
-			}
+	//Keeping the broad phase grid in sync with the scene. Objects that did not leave their cells are not touched.
+	//The grid is keyed on scene slots, which stay put when the scene is compacted.
+	for (uint32_t i = 0u; i < sceneGraph.size(); i++) {
+		if (sceneGraph.alive[i])
+			collisionGrid.update(sceneGraph.dense_slot[i], sceneGraph.location_x[i], sceneGraph.location_y[i], sceneGraph.collider_dimension[i] / 2);
+		else
+			collisionGrid.remove(sceneGraph.dense_slot[i]);
+	}
 
+	//Only objects sharing a grid cell are handed to isColliding(), and each pair is only tested once
+	collisionGrid.forEachCandidatePair([](uint32_t slot_i, uint32_t slot_j) {
+		uint32_t i = sceneGraph.slot_index[slot_i];
+		uint32_t j = sceneGraph.slot_index[slot_j];
+		if (!(sceneGraph.type[i] == OBSTACLE && sceneGraph.type[j] == OBSTACLE) && //We ignore the collision between two obstacles :-)
+			isColliding(i, j)) {
+			sceneGraph.collided[i] = 1;
+			sceneGraph.collided[j] = 1;
+			//cout << sceneGraph.type[i] << " has collided with" << sceneGraph.type[j] << endl;
 		}
-	}
+	});
 }
 
-//This function gets called every frame and updates the information written inside the sceneGraph.
-void updateSceneGraph() {
+//This function gets called once per simulation step (dt milliseconds) and updates the information written inside the sceneGraph.
+void updateSceneGraph(float dt) {
 
 	checkCollisions();	//Updating the collision status of all objects on the scene
 
-	for (int i = 0; i < sceneGraph.size(); i++) {
-
-		GameObject go = sceneGraph[i];
-		//cout << "Life Span: " << go.life_span << ", isAlive: " << go.isAlive << ", Living time: " << go.living_time << endl;
-
-		if (go.life_span > 0 && go.isAlive && go.living_time >= go.life_span)	//Check if the life of a Game Object is over
-		{
-		
-			go.isAlive = false;
-		}
-
-		if (go.life_span > 0 && go.isAlive && go.living_time < go.life_span) {	//If the Game Object is still alive and the object is not an obstacle
-
-			//1 - Updating the location
-			go.location += ((GLfloat) deltaTime) * go.velocity * glm::normalize(go.moving_direction);
-
-			
-			//2 - updating Time To Live
-			go.living_time += deltaTime;
-
-		}
+	//Check if the life of a Game Object is over, then update the location and Time To Live of every object
+	//that is still alive and is not an obstacle. This runs 4 or 8 objects at a time (see BatchIntegrator.h).
+	sceneGraph.update(dt);
 
-		sceneGraph[i] = go;	//Overwriting the game object data back into the SceneGraph
+	//Dead objects are swapped out once they make up a noticeable part of the scene, and their slots are recycled
+	if (sceneGraph.deadCount() >= 256 || sceneGraph.deadCount() * 8 >= sceneGraph.size()) {
+		sceneGraph.compact([](uint32_t slot) { collisionGrid.remove(slot); });
 	}
 }
 
@@ -395,41 +446,55 @@ void updateSceneGraph() {
 //Renders level
 void draw_level()
 {
+	MeshRegistry::bind(MeshID::level);
+
 	//Select the first texture (grass.png) when drawing the first geometry (floor)
 	glBindTexture(GL_TEXTURE_2D, texture[0]);
-	glDrawArrays(GL_QUADS, 0, 4);
-
-	updateSceneGraph();
-
-
-	for (int i = 0; i < sceneGraph.size(); i++){
-
-		GameObject go = sceneGraph[i];
-		//Processing each and every object in the Scene Graph
-		if (go.isAlive) {
-
-			//Render the object on the scene
-			model_view = glm::translate(model_view, go.location);
-			model_view = glm::rotate(model_view, 0.0f, unit_z_vector);	//For now, we do not consider the rotation. 
-			glUniformMatrix4fv(location, 1, GL_FALSE, &model_view[0][0]);
-			
-			//You may use different texture/geometry based on the game object type
-
-			if (go.type == OBSTACLE) {
-				drawCube(go.scale);
-			}
-			else if (go.type == BULLET) {
-				//I am using the same geometry/texture for bullets, however, you may use different
-				//cout << "Life Span: " << go.life_span << ", isAlive: " << go.isAlive << ", Living time: " << go.living_time << endl;
-				drawCube(go.scale);
-			}
-			
-			model_view = glm::mat4(1.0);
-			glUniformMatrix4fv(location, 1, GL_FALSE, &model_view[0][0]);
-		}	
-		else {/*You can remove it from the Game Scene, Or it can remain inside the Game Scene with isAlive=false*/}
+	glDrawElements(GL_TRIANGLE_STRIP, GroundIndexCount, GL_UNSIGNED_SHORT, BUFFER_OFFSET(0));
+
+	//The scene itself is advanced by the simulation thread. Taking its latest snapshot; objects are drawn between
+	//the last two simulation states.
+	render_snapshots.acquire();
+	const RenderSnapshot& snapshot = render_snapshots.readBuffer();
+	float alpha = snapshot.alpha(std::chrono::steady_clock::now());
+
+	//Sorting the live objects into one batch per geometry/texture pair.
+	//Obstacles and bullets currently share the cube geometry and the second texture (apple.png).
+	for (std::vector<CubeInstance>& batch : cube_instances)
+		batch.clear();
+
+	//Testing the bounding sphere of every object against the view frustum, 4 objects at a time
+	visible_objects.resize(snapshot.size());
+	cullSpheres(view_frustum, snapshot.location_x.data(), snapshot.location_y.data(), snapshot.location_z.data(),
+		snapshot.collider_dimension.data(), snapshot.size(), visible_objects.data());
+	cull_stats = CullStats();
+
+	//Processing each and every object in the snapshot (it only holds live objects)
+	for (size_t i = 0; i < snapshot.size(); i++){
+
+		if (!visible_objects[i]) {
+			cull_stats.culled++;	//Outside of the frustum, nothing to submit
+			continue;
+		}
+		cull_stats.visible++;
 
+		//You may use different texture/geometry based on the game object type (rotation is not considered for now)
+
+		if (snapshot.type[i] == OBSTACLE) {
+			cube_instances[1].push_back(CubeInstance{ snapshot.interpolatedLocation(i, 1.0f), snapshot.scale[i] });	//Obstacles do not move
+		}
+		else if (snapshot.type[i] == BULLET) {
+			//I am using the same geometry/texture for bullets, however, you may use different
+			cube_instances[1].push_back(CubeInstance{ snapshot.interpolatedLocation(i, alpha), snapshot.scale[i] });
+		}
 	}
+
+	//One draw call per batch instead of one per object
+	for (int i = 0; i < 2; i++)
+		drawCubesInstanced(cube_instances[i], texture[i]);
+
+	model_view = glm::mat4(1.0);
+	glUniformMatrix4fv(location, 1, GL_FALSE, &model_view[0][0]);
 }
 //End of codes developed by Alireza Moghaddam Nov. 21
 
@@ -440,6 +505,12 @@ void draw_level()
 //
 void display(void)
 {
+	//Textures whose files were decoded since the last frame; the copy into them runs on the GPU
+	size_t streaming = texture_streamer->pending();
+	texture_streamer->pump();
+	if (streaming > 0 && texture_streamer->pending() == 0)
+		texture_streamer->textureLoader().report(std::cout);
+
 	glEnable(GL_DEPTH_TEST);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	model_view = glm::mat4(1.0);
@@ -454,14 +525,42 @@ void display(void)
 	glm::mat4 proj_matrix = glm::frustum(-0.01f, +0.01f, -0.01f, +0.01f, 0.01f, 100.0f);
 	glUniformMatrix4fv(proj_mat_location, 1, GL_FALSE, &proj_matrix[0][0]);
 
+	view_frustum = Frustum::fromMatrix(proj_matrix * camera_matrix);
+
 	draw_level();
 
 	refresh_screen();
 
+	//Static meshes are uploaded once in init(). Any upload during the game means someone is re-sending geometry.
+	if (MeshRegistry::uploadCount() != static_mesh_uploads) {
+		std::cout << "Warning: " << MeshRegistry::uploadCount() - static_mesh_uploads << " static mesh uploads after init" << std::endl;
+		static_mesh_uploads = MeshRegistry::uploadCount();
+	}
+
 	glFlush();
 }
 
 
+//Added on Nov. 21 2021 by: Alireza Moghaddam
+//Describes a bullet fired from a location in a direction
+GameObject makeBullet(glm::vec3 from, glm::vec3 direction)
+{
+	GameObject go;
+	go.location = from;
+	go.rotation = glm::vec3(0, 0, 0);
+	go.scale = glm::vec3(0.01, 0.01, 0.01);
+	go.collider_dimension = go.scale.x;
+	go.isAlive = true;
+	go.living_time = 0;
+	go.isCollided = false;
+	go.velocity = 0.0001;
+	go.type = BULLET;
+	go.moving_direction = direction;
+	go.life_span = 2000;	//Each bullet lives for 2 seconds
+	return go;
+}
+//End of codes Added
+
 void keyboard(unsigned char key, int x, int y)
 {
 	if (key == 'a')
@@ -489,19 +588,8 @@ void keyboard(unsigned char key, int x, int y)
 	if (key == 'f')
 	{
 		//Create a bullet and place it inside the GameScene
-		GameObject go;
-		go.location = cam_pos;	//The bullet will spawn with an offset from the location of the player
-		go.rotation = glm::vec3(0, 0, 0);
-		go.scale = glm::vec3(0.01, 0.01, 0.01);
-		go.collider_dimension = go.scale.x;
-		go.isAlive = true;
-		go.living_time = 0;
-		go.isCollided = false;
-		go.velocity = 0.0001;
-		go.type = BULLET;
-		go.moving_direction = looking_dir_vector;
-		go.life_span = 2000;	//Each bullet lives for 2 seconds
-		sceneGraph.push_back(go);
+		std::lock_guard<std::mutex> lock(spawn_mutex);	//Handed over to the simulation thread
+		pending_spawns.push_back(makeBullet(cam_pos, looking_dir_vector));	//The bullet will spawn with an offset from the location of the player
 		
 	}
 	//End of codes Added 
@@ -549,6 +637,78 @@ void idle()
 	glutPostRedisplay();
 }
 
+//Body of the simulation thread. It owns sceneGraph: spawns the pending objects, advances the scene by as many fixed
+//steps as have elapsed in real time (measured with steady_clock) and publishes a snapshot for the renderer.
+void simulationLoop()
+{
+	typedef std::chrono::steady_clock clock;
+	std::vector<GameObject> spawns;
+
+	while (simulation_running) {
+		{
+			std::lock_guard<std::mutex> lock(spawn_mutex);
+			spawns.swap(pending_spawns);
+		}
+		for (const GameObject& go : spawns)
+			sceneGraph.spawn(go);
+
+		int steps = simulation_clock.advance([](float dt) {
+			clock::time_point tick_start = clock::now();
+			updateSceneGraph(dt);
+			simulation_busy_ms += std::chrono::duration<double, std::milli>(clock::now() - tick_start).count();
+		});
+
+		if (steps > 0 || !spawns.empty()) {
+			render_snapshots.writeBuffer().capture(sceneGraph, (float)simulation_clock.stepMs());
+			render_snapshots.publish();
+		}
+		spawns.clear();
+
+		//Sleeping until the next step is due
+		double wait_ms = (1.0 - simulation_clock.alpha()) * simulation_clock.stepMs();
+		std::this_thread::sleep_for(std::chrono::microseconds((long long)(wait_ms * 1000.0)));
+	}
+}
+
+//Publishes the initial state of the scene and starts the simulation thread
+void startSimulation()
+{
+	render_snapshots.writeBuffer().capture(sceneGraph, (float)simulation_clock.stepMs());
+	render_snapshots.publish();
+
+	simulation_running = true;
+	simulation_thread = std::thread(simulationLoop);
+}
+
+void stopSimulation()
+{
+	simulation_running = false;
+	if (simulation_thread.joinable())
+		simulation_thread.join();
+}
+
+//Runs the simulation in real time without GLUT or a GL context (for server use and benchmarks).
+//bullets: number of bullets fired in random directions at start-up. They live for the whole run.
+void runHeadless(double seconds, int bullets)
+{
+	initScene();
+	for (int i = 0; i < bullets; i++) {
+		GameObject go = makeBullet(glm::vec3(randomFloat(-100, 100), randomFloat(-100, 100), height),
+			glm::vec3(randomFloat(-1, 1), randomFloat(-1, 1), 0.01f));
+		go.life_span = (int)(seconds * 1000.0) + 1000;
+		sceneGraph.spawn(go);
+	}
+
+	//Same simulation thread as in the game, the main thread only waits for it
+	startSimulation();
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	stopSimulation();
+
+	unsigned long long ticks = simulation_clock.tickCount();
+	std::cout << "Headless run: " << ticks << " ticks in " << seconds << " s, " << sceneGraph.liveCount() << " live objects, "
+		<< (ticks > 0 ? simulation_busy_ms * 1000.0 / ticks : 0.0) << " us per tick" << std::endl;
+}
+
 void addPlayer(float x, float y)
 {
 	model_view = glm::mat4(1.0);
@@ -563,11 +723,20 @@ void addPlayer(float x, float y)
 //
 int main(int argc, char** argv)
 {
+	//Usage: 3D_World_Traversal --headless [seconds] [bullets]
+	if (argc > 1 && std::strcmp(argv[1], "--headless") == 0) {
+		runHeadless(argc > 2 ? std::atof(argv[2]) : 10.0, argc > 3 ? std::atoi(argv[3]) : 0);
+		return 0;
+	}
+
 	glutInit(&argc, argv);
+	glutInitContextVersion(4, 3);
+	glutInitContextProfile(GLUT_CORE_PROFILE);	//No GL_QUADS or other fixed-function leftovers are used anymore
 	glutInitDisplayMode(GLUT_RGBA);
 	glutInitWindowSize(1024, 1024);
 	glutCreateWindow("Camera and Projection");
 
+	glewExperimental = GL_TRUE;	//Needed by GLEW to load the entry points of a core profile context
 	glewInit();	//Initializes the glew and prepares the drawing pipeline.
 
 	init();
@@ -580,7 +749,12 @@ int main(int argc, char** argv)
 
 	glutPassiveMotionFunc(mouse);
 
+	//Returning from the main loop when the window is closed, so the simulation thread can be stopped cleanly
+	glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
+
 	glutMainLoop();
+
+	stopSimulation();
 	
 	
 
@@ -609,93 +783,63 @@ int main(int argc, char** argv)
 // ADDED BY YOUSEF
 constexpr char* CLIENT_NAME = "Yousef";
 Player this_player(Location(), CLIENT_NAME);
-std::vector<Player*> other_players{};
-SOCKET ClientSocket{};
+RemotePlayers remote_players{};							//Network thread -> main thread, see RemotePlayers.h
+TripleBuffer<Location> local_location{};				//Main thread -> network thread: where the camera is
+SnapshotInterpolator::Settings remote_motion{};			//How far behind remote players are drawn, and how far they are extrapolated
+GameClient game_client{};
 //Add your network initialization code here
 //To be added by Students
 void handle_communication()
 {
-	SerializedPlayer sp{};
-	size_t data_size{};
-	std::unique_ptr<char*> recv_buffer{};
-	Player recv_player{};
-	do
+	auto on_player = [](const PlayerView& view)
 	{
-		this_player.location.x = cam_pos.x; this_player.location.y = cam_pos.y; this_player.location.z = cam_pos.z;
-		sp = SerializedPlayer::player_serializer(this_player);
-		send(ClientSocket, *sp.data, sp.size, 0);
-		char s[1]{};
-		recv(ClientSocket, s, 1, 0);
-		data_size = std::strtol(s, NULL, 10);
-		send(ClientSocket, "ack", 3, 0);
-		recv_buffer = std::make_unique<char*>(new char[data_size * sizeof(Player)]{});
-		recv(ClientSocket, *recv_buffer, data_size * sizeof(Player), 0);
-		for (int i = 0; i < data_size; i++)
-		{
-			if (std::strlen(*recv_buffer) > 0)
-			{
-				recv_player = SerializedPlayer::player_deserializer(*recv_buffer);
-				auto& const name = recv_player.name;
-				auto found = std::find_if(other_players.begin(), other_players.end(), [&name](const Player* player)
-					{
-						return name == player->name;
-					});
-				if (found != other_players.cend())
-				{
-					(**found).location.update_loc(recv_player.location.x, recv_player.location.y, recv_player.location.z);
-					printPlayerInfo(*found);
-				}
-				else
-				{
-					other_players.push_back(&recv_player);
-					printPlayerInfo(&recv_player);
-					addPlayer(recv_player.location.x, recv_player.location.y);
-				}
-				*recv_buffer += sizeof(Player);
-			}
-		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(500));
-	}
-	while (true);
+		remote_players.onPlayer(view, game_client.arrivalTime(), game_client.lastSnapshot());
+	};
+	auto on_leave = [](uint32_t id) { remote_players.onLeave(id); };
+	auto local_player = [&]() -> const Player&
+	{
+		remote_players.flush();	//Called every update interval, so the backlog also drains while nothing arrives
+		local_location.acquire();
+		this_player.location = local_location.readBuffer();
+		return this_player;
+	};
+
+	//Returns only when the connection is lost; snapshots are handled the moment they arrive
+	game_client.run(local_player, on_player, on_leave);
 }
 
 
 void networkInitialize()
 {
-	// starts Winsock DLLs
-	WSADATA wsaData;
-	if ((WSAStartup(MAKEWORD(2, 2), &wsaData)) != 0)
-		return;
-
-	// initializes socket. SOCK_STREAM: TCP
-	ClientSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-	if (ClientSocket == INVALID_SOCKET)
-	{
-		WSACleanup();
+	if (!net::startup())
 		return;
-	}
-
-	// Connect socket to specified server
-	sockaddr_in SvrAddr{};
-	SvrAddr.sin_family = AF_INET;						// Address family type itnernet
-	SvrAddr.sin_port = htons(27000);					// port (host to network conversion)
-	SvrAddr.sin_addr.s_addr = inet_addr("127.0.0.1");	// IP address
-	if ((connect(ClientSocket, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr))) == SOCKET_ERROR)
+	if (!game_client.connect("127.0.0.1", 27000))
 	{
-		closesocket(ClientSocket);
-		WSACleanup();
+		net::cleanup();
 		return;
 	}
 
+	local_location.writeBuffer() = Location{ cam_pos.x, cam_pos.y, cam_pos.z };	//Refreshed every frame from then on
+	local_location.publish();
 	std::thread comm_thread(handle_communication);
 	comm_thread.detach();
 }
 
 void refresh_screen() //This function gets called for every frame of the game (after every screen refresh)
 {
-	for (const Player* player : other_players)
+	local_location.writeBuffer() = Location{ cam_pos.x, cam_pos.y, cam_pos.z };
+	local_location.publish();
+
+	remote_players.apply([](RemotePlayer& remote) { printPlayerInfo(&remote.player); });
+
+	//Remote players are drawn where they were a little while ago, between two received locations, so they move
+	//smoothly however rarely their locations arrive
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point latest_snapshot = game_client.lastSnapshot();
+	for (const RemotePlayer& remote : remote_players.all())
 	{
-		printPlayerInfo(player);
+		Location at = remote.motion.sample(now, latest_snapshot, remote_motion);
+		addPlayer(at.x, at.y);
 	};
 }
 
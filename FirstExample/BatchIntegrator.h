@@ -0,0 +1,200 @@
+#ifndef BATCH_INTEGRATOR_H
+#define BATCH_INTEGRATOR_H
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SDDS_TARGET_AVX2
+#else
+#define SDDS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace sdds
+{
+	//Views over the SceneStore arrays that the integrator reads and writes
+	struct IntegratorBatch
+	{
+		float* location_x{};
+		float* location_y{};
+		float* location_z{};
+		const float* direction_x{};	//Must be normalized
+		const float* direction_y{};
+		const float* direction_z{};
+		const float* velocity{};
+		float* living_time{};
+		const float* life_span{};
+		uint8_t* alive{};
+		uint8_t* expired{};			//Output: 1 for every object that died during this step, 0 otherwise
+		size_t count{};
+	};
+
+	//Advances a batch of objects by dt milliseconds.
+	//Every living object with a positive life span either expires (living_time >= life_span) or moves along its
+	//direction and ages by dt. Obstacles (negative life span) and dead objects are left untouched.
+	//Returns the number of objects that expired.
+	typedef size_t(*IntegrateFn)(const IntegratorBatch&, float);
+
+	//Reference implementation, also used for the tail of the vectorized versions
+	inline size_t integrateScalar(const IntegratorBatch& b, float dt, size_t first)
+	{
+		size_t expired = 0;
+		for (size_t i = first; i < b.count; i++)
+		{
+			bool active = b.alive[i] && b.life_span[i] > 0.0f;
+			bool over = active && b.living_time[i] >= b.life_span[i];
+			b.expired[i] = over ? 1 : 0;
+			b.alive[i] = uint8_t(b.alive[i] && !over);
+			expired += over;
+			if (active && !over)
+			{
+				float step = dt * b.velocity[i];
+				b.location_x[i] += step * b.direction_x[i];
+				b.location_y[i] += step * b.direction_y[i];
+				b.location_z[i] += step * b.direction_z[i];
+				b.living_time[i] += dt;
+			}
+		}
+		return expired;
+	}
+
+	inline size_t integrateScalar(const IntegratorBatch& b, float dt)
+	{
+		return integrateScalar(b, dt, 0);
+	}
+
+	inline size_t countBits(int mask)
+	{
+		size_t bits = 0;
+		for (; mask != 0; mask &= mask - 1)
+			bits++;
+		return bits;
+	}
+
+	//4 objects per iteration
+	inline size_t integrateSSE2(const IntegratorBatch& b, float dt)
+	{
+		const __m128i izero = _mm_setzero_si128();
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 vdt = _mm_set1_ps(dt);
+		size_t expired = 0;
+		size_t i = 0;
+		for (; i + 4 <= b.count; i += 4)
+		{
+			int32_t alive_bytes;
+			memcpy(&alive_bytes, b.alive + i, sizeof(alive_bytes));
+			__m128i alive32 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(alive_bytes), izero), izero);
+			__m128 alive = _mm_castsi128_ps(_mm_cmpgt_epi32(alive32, izero));
+
+			__m128 span = _mm_loadu_ps(b.life_span + i);
+			__m128 living = _mm_loadu_ps(b.living_time + i);
+			__m128 active = _mm_and_ps(alive, _mm_cmpgt_ps(span, zero));
+			__m128 over = _mm_and_ps(active, _mm_cmpge_ps(living, span));
+			__m128 moving = _mm_andnot_ps(over, active);
+
+			__m128 step = _mm_and_ps(moving, _mm_mul_ps(vdt, _mm_loadu_ps(b.velocity + i)));
+			_mm_storeu_ps(b.location_x + i, _mm_add_ps(_mm_loadu_ps(b.location_x + i), _mm_mul_ps(step, _mm_loadu_ps(b.direction_x + i))));
+			_mm_storeu_ps(b.location_y + i, _mm_add_ps(_mm_loadu_ps(b.location_y + i), _mm_mul_ps(step, _mm_loadu_ps(b.direction_y + i))));
+			_mm_storeu_ps(b.location_z + i, _mm_add_ps(_mm_loadu_ps(b.location_z + i), _mm_mul_ps(step, _mm_loadu_ps(b.direction_z + i))));
+			_mm_storeu_ps(b.living_time + i, _mm_add_ps(living, _mm_and_ps(moving, vdt)));
+
+			//Narrowing the 32 bit lane masks down to one byte per object for the expired/alive byte arrays
+			__m128i over8 = _mm_packs_epi16(_mm_packs_epi32(_mm_castps_si128(over), izero), izero);
+			int32_t over_bytes = _mm_cvtsi128_si32(over8);
+			int32_t expired_bytes = over_bytes & 0x01010101;
+			alive_bytes &= ~over_bytes;
+			memcpy(b.expired + i, &expired_bytes, sizeof(expired_bytes));
+			memcpy(b.alive + i, &alive_bytes, sizeof(alive_bytes));
+			expired += countBits(_mm_movemask_ps(over));
+		}
+		return expired + integrateScalar(b, dt, i);
+	}
+
+	//8 objects per iteration
+	SDDS_TARGET_AVX2 inline size_t integrateAVX2(const IntegratorBatch& b, float dt)
+	{
+		const __m256i izero = _mm256_setzero_si256();
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 vdt = _mm256_set1_ps(dt);
+		size_t expired = 0;
+		size_t i = 0;
+		for (; i + 8 <= b.count; i += 8)
+		{
+			__m128i alive8 = _mm_loadl_epi64((const __m128i*)(b.alive + i));
+			__m256i alive32 = _mm256_cvtepu8_epi32(alive8);
+			__m256 alive = _mm256_castsi256_ps(_mm256_cmpgt_epi32(alive32, izero));
+
+			__m256 span = _mm256_loadu_ps(b.life_span + i);
+			__m256 living = _mm256_loadu_ps(b.living_time + i);
+			__m256 active = _mm256_and_ps(alive, _mm256_cmp_ps(span, zero, _CMP_GT_OQ));
+			__m256 over = _mm256_and_ps(active, _mm256_cmp_ps(living, span, _CMP_GE_OQ));
+			__m256 moving = _mm256_andnot_ps(over, active);
+
+			__m256 step = _mm256_and_ps(moving, _mm256_mul_ps(vdt, _mm256_loadu_ps(b.velocity + i)));
+			_mm256_storeu_ps(b.location_x + i, _mm256_add_ps(_mm256_loadu_ps(b.location_x + i), _mm256_mul_ps(step, _mm256_loadu_ps(b.direction_x + i))));
+			_mm256_storeu_ps(b.location_y + i, _mm256_add_ps(_mm256_loadu_ps(b.location_y + i), _mm256_mul_ps(step, _mm256_loadu_ps(b.direction_y + i))));
+			_mm256_storeu_ps(b.location_z + i, _mm256_add_ps(_mm256_loadu_ps(b.location_z + i), _mm256_mul_ps(step, _mm256_loadu_ps(b.direction_z + i))));
+			_mm256_storeu_ps(b.living_time + i, _mm256_add_ps(living, _mm256_and_ps(moving, vdt)));
+
+			__m256i over32 = _mm256_castps_si256(over);
+			__m128i over16 = _mm_packs_epi32(_mm256_castsi256_si128(over32), _mm256_extracti128_si256(over32, 1));
+			__m128i over8 = _mm_packs_epi16(over16, _mm_setzero_si128());
+			_mm_storel_epi64((__m128i*)(b.expired + i), _mm_and_si128(over8, _mm_set1_epi8(1)));
+			_mm_storel_epi64((__m128i*)(b.alive + i), _mm_andnot_si128(over8, alive8));
+			expired += countBits(_mm256_movemask_ps(over));
+		}
+		return expired + integrateScalar(b, dt, i);
+	}
+
+	//Asks the CPU (and the OS, for the AVX register state) which instruction sets can be used
+	inline bool cpuHasAVX2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	inline bool cpuHasSSE2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		return (info[3] & (1 << 26)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse2");
+#endif
+	}
+
+	//Picks the widest integrator the running CPU supports. The choice is made once and cached.
+	inline IntegrateFn selectIntegrator(const char** name = nullptr)
+	{
+		static const char* selected_name = nullptr;
+		static const IntegrateFn selected = []() {
+			if (cpuHasAVX2()) { selected_name = "AVX2"; return IntegrateFn(integrateAVX2); }
+			if (cpuHasSSE2()) { selected_name = "SSE2"; return IntegrateFn(integrateSSE2); }
+			selected_name = "scalar";
+			return IntegrateFn(static_cast<size_t(*)(const IntegratorBatch&, float)>(integrateScalar));
+		}();
+		if (name != nullptr)
+			*name = selected_name;
+		return selected;
+	}
+}
+
+#endif // !BATCH_INTEGRATOR_H
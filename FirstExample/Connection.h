@@ -0,0 +1,81 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+#include <cstring>
+#include <utility>
+#include <vector>
+#include "Socket.h"
+#include "WireFormat.h"
+
+namespace sdds
+{
+	//A non-blocking stream socket with framing on both sides: received bytes are reassembled into frames, and
+	//frames to send are queued and written out as far as the socket takes them.
+	class Connection
+	{
+		std::vector<char> outbox{};
+		size_t outbox_sent{};
+
+	public:
+		net::Socket socket{};
+		wire::FrameReader reader{};
+
+		Connection() = default;
+		explicit Connection(net::Socket s) : socket(std::move(s)) {}
+
+		//Queued bytes to append frames to. Call flush() to send them.
+		std::vector<char>& outgoing() { return outbox; }
+
+		//True while queued bytes wait for the socket to become writable
+		bool wantsWrite() const { return outbox_sent < outbox.size(); }
+
+		size_t pendingBytes() const { return outbox.size() - outbox_sent; }
+
+		void queue(const char* data, size_t length)
+		{
+			outbox.insert(outbox.end(), data, data + length);
+		}
+
+		//Sends queued bytes until everything is sent (Io_Ok) or the socket is full (Io_WouldBlock)
+		net::IoStatus flush()
+		{
+			while (outbox_sent < outbox.size())
+			{
+				size_t sent = 0;
+				net::IoStatus status = socket.send(outbox.data() + outbox_sent, outbox.size() - outbox_sent, sent);
+				if (status != net::Io_Ok)
+					return status;
+				outbox_sent += sent;
+			}
+			outbox.clear();
+			outbox_sent = 0;
+			return net::Io_Ok;
+		}
+
+		//Reads everything the socket has and calls on_frame(const wire::FrameHeader&, const char* payload) for every
+		//complete frame. Returns Io_WouldBlock once the socket is drained, Io_Closed or Io_Error when it is done.
+		template <typename F>
+		net::IoStatus receive(F&& on_frame)
+		{
+			while (true)
+			{
+				size_t space = 0;
+				char* buffer = reader.space(space);
+				size_t received = 0;
+				net::IoStatus status = socket.receive(buffer, space, received);
+				if (status != net::Io_Ok)
+					return status;
+				reader.commit(received);
+
+				wire::FrameHeader header;
+				const char* payload = nullptr;
+				while (reader.next(header, payload))
+				{
+					if (header.version == wire::Protocol_Version)
+						on_frame(static_cast<const wire::FrameHeader&>(header), payload);
+				}
+			}
+		}
+	};
+}
+
+#endif // !CONNECTION_H
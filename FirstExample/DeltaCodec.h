@@ -0,0 +1,537 @@
+#ifndef DELTA_CODEC_H
+#define DELTA_CODEC_H
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Player.h"
+#include "PlayerSerializer.h"
+#include "WireFormat.h"
+
+namespace sdds
+{
+	//Snapshot delta compression.
+	//The sender numbers every snapshot it sends to a client and keeps the last Delta_Ring_Size of them. The client
+	//acknowledges the newest snapshot it has decoded (Msg_Ack), and the next snapshot is encoded against that one:
+	//players that did not move are left out, players that moved only carry the axes that changed, as quantized
+	//differences. Players are referred to by id; a name is sent at most once, either inside the delta when a player
+	//first shows up in a client's snapshots (Delta_Name), or out of band (see Session.h) so that deltas can go over
+	//an unreliable channel. An idle player therefore costs nothing, and a whole idle snapshot is about a dozen bytes.
+	//
+	//Msg_Delta payload:
+	//
+	//    varint sequence | varint baseline sequence (0: none) |
+	//    varint removed count | removed ids (varint, each relative to the previous) |
+	//    varint entry count | entries
+	//
+	//    entry: varint id (relative to the previous) | u8 flags | [varint name length | name] | zigzag varint per axis
+	//
+	//With Delta_New the axes are absolute quantized coordinates, otherwise differences to the baseline. The name is
+	//only there with Delta_Name.
+	//Ids are sorted in both lists.
+	//
+	//A world too big for one Msg_Delta frame goes out as Msg_Positions frames instead, which are not acknowledged:
+	//
+	//    varint count | records: varint id (relative to the previous) | zigzag varint per axis, absolute
+	namespace wire
+	{
+		enum : uint8_t
+		{
+			Msg_Delta = 3,	//Delta snapshot, see DeltaCodec.h
+			Msg_Ack = 4,	//varint sequence of the newest decoded Msg_Delta
+			Msg_Positions = 9,	//Every player's location by id, the fallback for Msg_Delta
+		};
+
+		enum : uint8_t
+		{
+			Delta_X = 0x1,
+			Delta_Y = 0x2,
+			Delta_Z = 0x4,
+			Delta_New = 0x8,	//Not in the baseline: all three axes are absolute
+			Delta_Name = 0x10,	//The name follows the flags
+		};
+
+		//Writes a complete Msg_Ack frame (at most Frame_Header_Size + Max_Varint_Size bytes). Returns its size.
+		inline size_t putAckFrame(char* out, uint32_t sequence)
+		{
+			size_t payload = putVarint(out + Frame_Header_Size, sequence);
+			putFrameHeader(out, uint16_t(payload), Msg_Ack);
+			return Frame_Header_Size + payload;
+		}
+	}
+
+	enum : uint32_t { Delta_Ring_Size = 32 };
+
+	//A player as the delta codec sees it: its id in the name table and its quantized location
+	struct QuantizedPlayer
+	{
+		uint32_t id{};
+		int32_t x{}, y{}, z{};
+
+		static QuantizedPlayer fromPlayer(uint32_t id, const Player& player)
+		{
+			return QuantizedPlayer{ id, wire::quantize(player.location.x), wire::quantize(player.location.y),
+				wire::quantize(player.location.z) };
+		}
+
+		Location location() const
+		{
+			return Location{ wire::dequantize(x), wire::dequantize(y), wire::dequantize(z) };
+		}
+	};
+
+	namespace wire
+	{
+		enum : size_t { Positions_Per_Frame = (Max_Payload_Size - Max_Varint_Size) / (4 * Max_Varint_Size) };
+
+		//Appends Msg_Positions frames for players (sorted by id, ids unique) to out, as many as needed
+		inline void putPositions(std::vector<char>& out, const QuantizedPlayer* players, size_t count)
+		{
+			while (count > 0)
+			{
+				size_t records = count < Positions_Per_Frame ? count : size_t(Positions_Per_Frame);
+				size_t at = out.size();
+				out.resize(at + Frame_Header_Size + Max_Varint_Size * (1 + 4 * records));
+				char* payload = out.data() + at + Frame_Header_Size;
+				char* cursor = payload + putVarint(payload, uint32_t(records));
+				uint32_t previous = 0;
+				for (size_t i = 0; i < records; i++)
+				{
+					cursor += putVarint(cursor, players[i].id - previous);
+					cursor += putVarint(cursor, zigzag(players[i].x));
+					cursor += putVarint(cursor, zigzag(players[i].y));
+					cursor += putVarint(cursor, zigzag(players[i].z));
+					previous = players[i].id;
+				}
+				size_t length = size_t(cursor - payload);
+				putFrameHeader(out.data() + at, uint16_t(length), Msg_Positions);
+				out.resize(at + Frame_Header_Size + length);
+				players += records;
+				count -= records;
+			}
+		}
+
+		//Calls on_position(const QuantizedPlayer&) for every record of a Msg_Positions payload. Returns false
+		//(possibly after some records were delivered) when the payload is malformed.
+		template <typename F>
+		bool getPositions(const char* payload, size_t length, F&& on_position)
+		{
+			const char* cursor = payload;
+			const char* end = payload + length;
+			uint32_t count;
+			if (!getVarint(cursor, end, count))
+				return false;
+			QuantizedPlayer p;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				uint32_t delta, x, y, z;
+				if (!getVarint(cursor, end, delta) || (i > 0 && delta == 0) || p.id + delta < p.id ||
+					!getVarint(cursor, end, x) || !getVarint(cursor, end, y) || !getVarint(cursor, end, z))
+					return false;
+				p.id += delta;
+				p.x = unzigzag(x);
+				p.y = unzigzag(y);
+				p.z = unzigzag(z);
+				on_position(static_cast<const QuantizedPlayer&>(p));
+			}
+			return true;
+		}
+	}
+
+	//One numbered snapshot, players sorted by id
+	struct DeltaSnapshot
+	{
+		uint32_t sequence{};
+		std::vector<QuantizedPlayer> players{};
+	};
+
+	//Sender side, one per client
+	class DeltaEncoder
+	{
+		DeltaSnapshot ring[Delta_Ring_Size]{};
+		uint32_t next_sequence{ 1 };
+		uint32_t acked{};
+		std::vector<char> payload{};
+
+		const DeltaSnapshot* baseline() const
+		{
+			//The slot of next_sequence is about to be overwritten, so the baseline must be newer than that
+			if (acked == 0 || next_sequence - acked >= Delta_Ring_Size)
+				return nullptr;
+			const DeltaSnapshot& s = ring[acked % Delta_Ring_Size];
+			return s.sequence == acked ? &s : nullptr;
+		}
+
+		static char* reserve(std::vector<char>& payload, size_t used, size_t bytes)
+		{
+			if (payload.size() < used + bytes)
+				payload.resize((used + bytes) * 2);
+			return payload.data() + used;
+		}
+
+	public:
+		//Handles a Msg_Ack from the client. Acks for snapshots that were never sent, or older than the current
+		//baseline, are ignored.
+		void acknowledge(uint32_t sequence)
+		{
+			if (sequence < next_sequence && sequence > acked)
+				acked = sequence;
+		}
+
+		uint32_t ackedSequence() const { return acked; }
+
+		//Appends a Msg_Delta frame numbered sequence that turns base (null: nothing) into players (sorted by id,
+		//ids unique) to out. name_of(id) returns a pointer to the name of a player, or null to leave names out; it is
+		//only called for players not in base.
+		//payload is scratch space. Returns false, and appends nothing, when the delta does not fit into one frame.
+		//Stateless, so a server can encode once and send the frame to every client that acknowledged the same base.
+		template <typename NameOf>
+		static bool write(const DeltaSnapshot* base, uint32_t sequence, const QuantizedPlayer* players, size_t count,
+			NameOf&& name_of, std::vector<char>& payload, std::vector<char>& out)
+		{
+			const QuantizedPlayer* base_players = base ? base->players.data() : nullptr;
+			size_t base_count = base ? base->players.size() : 0;
+
+			size_t used = 0;
+			char* cursor = reserve(payload, used, 2 * wire::Max_Varint_Size);
+			used += wire::putVarint(cursor, sequence);
+			used += wire::putVarint(payload.data() + used, base ? base->sequence : 0);
+
+			//Players of the baseline that are gone
+			uint32_t removed = 0;
+			size_t i = 0, j = 0;
+			for (; i < base_count; i++)
+			{
+				while (j < count && players[j].id < base_players[i].id)
+					j++;
+				if (j == count || players[j].id != base_players[i].id)
+					removed++;
+			}
+			cursor = reserve(payload, used, wire::Max_Varint_Size * (1 + size_t(removed)));
+			used += wire::putVarint(cursor, removed);
+			uint32_t previous = 0;
+			for (i = 0, j = 0; i < base_count; i++)
+			{
+				while (j < count && players[j].id < base_players[i].id)
+					j++;
+				if (j == count || players[j].id != base_players[i].id)
+				{
+					used += wire::putVarint(payload.data() + used, base_players[i].id - previous);
+					previous = base_players[i].id;
+				}
+			}
+
+			//New and changed players. The entry count is only known at the end, so it gets the maximum varint size
+			//now and the entries are moved down afterwards.
+			size_t count_at = used;
+			reserve(payload, used, wire::Max_Varint_Size);
+			used += wire::Max_Varint_Size;
+			uint32_t entries = 0;
+			previous = 0;
+			for (i = 0, j = 0; j < count; j++)
+			{
+				const QuantizedPlayer& p = players[j];
+				while (i < base_count && base_players[i].id < p.id)
+					i++;
+				const QuantizedPlayer* b = (i < base_count && base_players[i].id == p.id) ? &base_players[i] : nullptr;
+
+				uint8_t flags = 0;
+				int32_t dx = p.x, dy = p.y, dz = p.z;
+				if (b)
+				{
+					dx = int32_t(uint32_t(p.x) - uint32_t(b->x));
+					dy = int32_t(uint32_t(p.y) - uint32_t(b->y));
+					dz = int32_t(uint32_t(p.z) - uint32_t(b->z));
+					flags = uint8_t((dx ? wire::Delta_X : 0) | (dy ? wire::Delta_Y : 0) | (dz ? wire::Delta_Z : 0));
+					if (flags == 0)
+						continue;
+				}
+				else
+				{
+					flags = wire::Delta_New | wire::Delta_X | wire::Delta_Y | wire::Delta_Z;
+				}
+
+				const std::string* name = (flags & wire::Delta_New) ? name_of(p.id) : nullptr;
+				if (name)
+					flags |= wire::Delta_Name;
+
+				cursor = reserve(payload, used, 5 * wire::Max_Varint_Size + 1);
+				cursor += wire::putVarint(cursor, p.id - previous);
+				*cursor++ = char(flags);
+				if (name)
+				{
+					size_t at = size_t(cursor - payload.data());
+					cursor = reserve(payload, at, wire::Max_Varint_Size + name->size() + 3 * wire::Max_Varint_Size);
+					cursor += wire::putVarint(cursor, uint32_t(name->size()));
+					name->copy(cursor, name->size());
+					cursor += name->size();
+				}
+				if (flags & wire::Delta_X)
+					cursor += wire::putVarint(cursor, wire::zigzag(dx));
+				if (flags & wire::Delta_Y)
+					cursor += wire::putVarint(cursor, wire::zigzag(dy));
+				if (flags & wire::Delta_Z)
+					cursor += wire::putVarint(cursor, wire::zigzag(dz));
+				used = size_t(cursor - payload.data());
+				previous = p.id;
+				entries++;
+			}
+
+			char count_bytes[wire::Max_Varint_Size];
+			size_t count_size = wire::putVarint(count_bytes, entries);
+			size_t entries_at = count_at + wire::Max_Varint_Size;
+			memmove(payload.data() + count_at + count_size, payload.data() + entries_at, used - entries_at);
+			memcpy(payload.data() + count_at, count_bytes, count_size);
+			used -= wire::Max_Varint_Size - count_size;
+			if (used > wire::Max_Payload_Size)
+				return false;
+
+			size_t frame = out.size();
+			out.resize(frame + wire::Frame_Header_Size + used);
+			wire::putFrameHeader(out.data() + frame, uint16_t(used), wire::Msg_Delta);
+			memcpy(out.data() + frame + wire::Frame_Header_Size, payload.data(), used);
+			return true;
+		}
+
+
+		//Appends the next Msg_Delta frame for the given players (sorted by id, ids unique) to out, encoded against
+		//the newest acknowledged snapshot still in the ring. name_of(id) returns a pointer to the name of a player
+		//(or null, see write()); it is only called for players the client does not know yet.
+		//Returns false, and appends nothing, when the delta does not fit into one frame. The sequence is not used
+		//up in that case and the caller can fall back to Msg_Positions frames (see wire::putPositions()).
+		template <typename NameOf>
+		bool encode(const QuantizedPlayer* players, size_t count, NameOf&& name_of, std::vector<char>& out)
+		{
+			uint32_t sequence = next_sequence;
+			if (!write(baseline(), sequence, players, count, name_of, payload, out))
+				return false;
+
+			DeltaSnapshot& slot = ring[sequence % Delta_Ring_Size];
+			slot.sequence = sequence;
+			slot.players.assign(players, players + count);
+			next_sequence++;
+			return true;
+		}
+	};
+
+	//Receiver side
+	class DeltaDecoder
+	{
+		DeltaSnapshot ring[Delta_Ring_Size]{};
+		DeltaSnapshot next{};
+		std::unordered_map<uint32_t, std::string> names{};
+		std::vector<uint32_t> removed{};
+		std::vector<uint32_t> departed{};
+		struct Named
+		{
+			size_t index{};			//Into next.players
+			const char* name{};		//Into the payload
+			uint32_t name_length{};
+		};
+		std::vector<Named> named{};		//Entries with Delta_Name, in index order
+		std::vector<size_t> reported{};	//Into next.players: new, moved or named since the previous snapshot
+		uint32_t latest{};
+
+	public:
+		//Sequence of the newest decoded snapshot, to be acknowledged to the sender (0: none yet)
+		uint32_t latestSequence() const { return latest; }
+
+		//The newest decoded snapshot
+		const DeltaSnapshot& current() const { return ring[latest % Delta_Ring_Size]; }
+
+		const std::string& name(uint32_t id) { return names[id]; }
+
+		//The player's name, or null when it is not known (yet, or any more)
+		const std::string* knownName(uint32_t id) const
+		{
+			auto found = names.find(id);
+			return found == names.end() ? nullptr : &found->second;
+		}
+
+		//Drops the name of a player that left. Its records are no longer reported, even from deltas sent before it
+		//left.
+		void forget(uint32_t id) { names.erase(id); }
+
+		//Records a name received out of band. Returns true, with the player's location, when the player is in the
+		//newest snapshot: its updates were held back for want of a name and it should be reported now.
+		bool setName(uint32_t id, const std::string& name, Location& location)
+		{
+			names[id] = name;
+			const std::vector<QuantizedPlayer>& players = current().players;
+			auto found = std::lower_bound(players.begin(), players.end(), id,
+				[](const QuantizedPlayer& p, uint32_t key) { return p.id < key; });
+			if (found == players.end() || found->id != id)
+				return false;
+			location = found->location();
+			return true;
+		}
+
+		//Decodes the payload of a Msg_Delta frame and calls on_player(const PlayerView&) for every player whose name is
+		//known and that is new or moved, then on_leave(uint32_t id) for every player of the previous snapshot that is
+		//not in this one. Both come from comparing the result with the previous decoded snapshot, not from the entries
+		//and the removed list: those are relative to the baseline, and miss a player that moved back to its baseline
+		//location, or came and went, since the baseline. Returns false for malformed input,
+		//stale snapshots and snapshots whose baseline is no longer known; the decoder's state is left unchanged then.
+		template <typename F, typename L>
+		bool decode(const char* payload, size_t length, F&& on_player, L&& on_leave)
+		{
+			const char* cursor = payload;
+			const char* end = payload + length;
+			uint32_t sequence, base_sequence, removed_count, entry_count;
+			if (!wire::getVarint(cursor, end, sequence) || !wire::getVarint(cursor, end, base_sequence))
+				return false;
+			if (sequence == 0 || sequence <= latest)
+				return false;
+
+			const DeltaSnapshot* base = nullptr;
+			if (base_sequence != 0)
+			{
+				base = &ring[base_sequence % Delta_Ring_Size];
+				if (base->sequence != base_sequence || base_sequence >= sequence)
+					return false;
+			}
+			const QuantizedPlayer* base_players = base ? base->players.data() : nullptr;
+			size_t base_count = base ? base->players.size() : 0;
+
+			if (!wire::getVarint(cursor, end, removed_count) || removed_count > base_count)
+				return false;
+			removed.clear();
+			uint32_t id = 0;
+			for (uint32_t r = 0; r < removed_count; r++)
+			{
+				uint32_t delta;
+				if (!wire::getVarint(cursor, end, delta) || (r > 0 && delta == 0) || id + delta < id)
+					return false;
+				id += delta;
+				removed.push_back(id);
+			}
+
+			//Merge the baseline (minus removed players) with the entries, both sorted by id
+			next.players.clear();
+			size_t b = 0, r = 0;
+			auto copy_base_until = [&](uint64_t limit)
+			{
+				for (; b < base_count && base_players[b].id < limit; b++)
+				{
+					while (r < removed.size() && removed[r] < base_players[b].id)
+						r++;
+					if (r == removed.size() || removed[r] != base_players[b].id)
+						next.players.push_back(base_players[b]);
+				}
+			};
+
+			if (!wire::getVarint(cursor, end, entry_count))
+				return false;
+			named.clear();
+			id = 0;
+			for (uint32_t e = 0; e < entry_count; e++)
+			{
+				uint32_t delta;
+				if (!wire::getVarint(cursor, end, delta) || (e > 0 && delta == 0) || id + delta < id || cursor >= end)
+					return false;
+				id += delta;
+				uint8_t flags = uint8_t(*cursor++);
+
+				copy_base_until(id);
+				bool in_base = b < base_count && base_players[b].id == id;
+				QuantizedPlayer p = in_base ? base_players[b] : QuantizedPlayer{ id };
+				if (in_base)
+					b++;
+				if (!in_base && !(flags & wire::Delta_New))
+					return false;
+
+				if (flags & wire::Delta_Name)
+				{
+					uint32_t name_length;
+					if (!wire::getVarint(cursor, end, name_length) || name_length > size_t(end - cursor))
+						return false;
+					named.push_back(Named{ next.players.size(), cursor, name_length });
+					cursor += name_length;
+				}
+				if (flags & wire::Delta_New)
+					p.x = p.y = p.z = 0;
+				uint32_t v;
+				if (flags & wire::Delta_X)
+				{
+					if (!wire::getVarint(cursor, end, v))
+						return false;
+					p.x = int32_t(uint32_t(p.x) + uint32_t(wire::unzigzag(v)));
+				}
+				if (flags & wire::Delta_Y)
+				{
+					if (!wire::getVarint(cursor, end, v))
+						return false;
+					p.y = int32_t(uint32_t(p.y) + uint32_t(wire::unzigzag(v)));
+				}
+				if (flags & wire::Delta_Z)
+				{
+					if (!wire::getVarint(cursor, end, v))
+						return false;
+					p.z = int32_t(uint32_t(p.z) + uint32_t(wire::unzigzag(v)));
+				}
+				next.players.push_back(p);
+			}
+			copy_base_until(uint64_t(1) << 32);
+			if (cursor != end)
+				return false;
+
+			//Only now that the whole payload is known to be good: publish the snapshot and report the changes.
+			//The previous snapshot may share the ring slot with this one, so it is compared first.
+			const QuantizedPlayer* before = latest != 0 ? current().players.data() : nullptr;
+			size_t before_count = latest != 0 ? current().players.size() : 0;
+			size_t o = 0, at_name = 0;
+			departed.clear();
+			reported.clear();
+			for (size_t n = 0; n < next.players.size(); n++)
+			{
+				const QuantizedPlayer& p = next.players[n];
+				for (; o < before_count && before[o].id < p.id; o++)
+					departed.push_back(before[o].id);
+				bool moved = true;
+				if (o < before_count && before[o].id == p.id)
+				{
+					moved = before[o].x != p.x || before[o].y != p.y || before[o].z != p.z;
+					o++;
+				}
+				while (at_name < named.size() && named[at_name].index < n)
+					at_name++;
+				if (moved || (at_name < named.size() && named[at_name].index == n))
+					reported.push_back(n);
+			}
+			for (; o < before_count; o++)
+				departed.push_back(before[o].id);
+
+			next.sequence = sequence;
+			std::swap(ring[sequence % Delta_Ring_Size], next);
+			latest = sequence;
+
+			const DeltaSnapshot& snapshot = current();
+			for (const Named& n : named)
+				names[snapshot.players[n.index].id].assign(n.name, n.name_length);
+			for (size_t index : reported)
+			{
+				const QuantizedPlayer& p = snapshot.players[index];
+				auto known_name = names.find(p.id);
+				if (known_name == names.end())
+					continue;
+				const std::string& known = known_name->second;
+				PlayerView view;
+				view.name = known.data();
+				view.name_length = uint32_t(known.size());
+				view.location = p.location();
+				view.id = p.id;
+				on_player(static_cast<const PlayerView&>(view));
+			}
+			for (uint32_t id : departed)
+			{
+				names.erase(id);
+				on_leave(id);
+			}
+			return true;
+		}
+	};
+}
+
+#endif // !DELTA_CODEC_H
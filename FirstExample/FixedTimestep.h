@@ -0,0 +1,65 @@
+#ifndef FIXED_TIMESTEP_H
+#define FIXED_TIMESTEP_H
+#include <chrono>
+
+namespace sdds
+{
+	//Fixed timestep driver for the simulation.
+	//Real time is measured with std::chrono::steady_clock and accumulated; every time a whole step has accumulated the
+	//simulation is advanced by exactly one step. What is left over (alpha) tells the renderer how far it is between
+	//the last two simulation states, so it can interpolate instead of showing the simulation's own cadence.
+	class FixedTimestep
+	{
+		typedef std::chrono::steady_clock clock;
+
+		double step_ms{};
+		int max_steps{};				//Upper bound of steps per advance(), so a long stall cannot snowball
+		double accumulator_ms{};
+		clock::time_point last{};
+		bool started{};
+		unsigned long long ticks{};
+
+	public:
+		explicit FixedTimestep(double step = 1000.0 / 120.0, int max_steps_per_advance = 8)
+			: step_ms(step), max_steps(max_steps_per_advance) {}
+
+		//Runs step(dt) once for every full step of real time elapsed since the last call, dt being the step length
+		//in milliseconds. Returns the number of steps run.
+		template <typename F>
+		int advance(F&& step)
+		{
+			clock::time_point now = clock::now();
+			if (!started)
+			{
+				last = now;
+				started = true;
+			}
+			accumulator_ms += std::chrono::duration<double, std::milli>(now - last).count();
+			last = now;
+
+			int steps = 0;
+			while (accumulator_ms >= step_ms && steps < max_steps)
+			{
+				step(float(step_ms));
+				accumulator_ms -= step_ms;
+				steps++;
+			}
+			if (steps == max_steps && accumulator_ms >= step_ms)
+				accumulator_ms = 0.0;	//Fell too far behind: drop the backlog instead of trying to catch up
+
+			ticks += steps;
+			return steps;
+		}
+
+		//Fraction of a step accumulated since the last simulation step, in [0, 1)
+		float alpha() const
+		{
+			return float(accumulator_ms / step_ms);
+		}
+
+		double stepMs() const { return step_ms; }
+		unsigned long long tickCount() const { return ticks; }
+	};
+}
+
+#endif // !FIXED_TIMESTEP_H
@@ -0,0 +1,112 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <emmintrin.h>
+#include "glm\glm.hpp"
+
+namespace sdds
+{
+	//The six planes of a view frustum, in world space. Every plane is stored as (normal, distance) with the normal
+	//pointing into the frustum and normalized, so dot(normal, p) + distance is the signed distance of p to the plane.
+	struct Frustum
+	{
+		glm::vec4 planes[6]{};
+
+		//Extracts the planes from projection * camera (Gribb/Hartmann). glm matrices are column major: m[column][row].
+		static Frustum fromMatrix(const glm::mat4& m)
+		{
+			glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+			glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+			glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+			glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+			Frustum f;
+			f.planes[0] = row3 + row0;	//Left
+			f.planes[1] = row3 - row0;	//Right
+			f.planes[2] = row3 + row1;	//Bottom
+			f.planes[3] = row3 - row1;	//Top
+			f.planes[4] = row3 + row2;	//Near
+			f.planes[5] = row3 - row2;	//Far
+			for (glm::vec4& p : f.planes)
+				p /= glm::length(glm::vec3(p));
+			return f;
+		}
+
+		bool containsSphere(const glm::vec3& center, float radius) const
+		{
+			for (const glm::vec4& p : planes)
+				if (glm::dot(glm::vec3(p), center) + p.w < -radius)
+					return false;
+			return true;
+		}
+	};
+
+	//Per-frame culling counters
+	struct CullStats
+	{
+		size_t visible{};
+		size_t culled{};
+	};
+
+	//Tests the bounding spheres of a batch of scene objects against the frustum and writes 1 (visible) or 0 (culled)
+	//per object into visible[]. Objects are the boxes drawn from the level mesh: they stand on their location and are
+	//about one collider dimension wide and tall, so the sphere is centered half a collider above the location and
+	//uses the collider dimension as a (conservative) radius. Returns the number of visible objects.
+	//Four objects are tested per iteration with SSE2, which every x64 CPU has.
+	inline size_t cullSpheres(const Frustum& frustum, const float* location_x, const float* location_y, const float* location_z,
+		const float* collider_dimension, size_t count, uint8_t* visible)
+	{
+		size_t visible_count = 0;
+		size_t i = 0;
+
+		__m128 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+		for (int p = 0; p < 6; p++)
+		{
+			plane_x[p] = _mm_set1_ps(frustum.planes[p].x);
+			plane_y[p] = _mm_set1_ps(frustum.planes[p].y);
+			plane_z[p] = _mm_set1_ps(frustum.planes[p].z);
+			plane_w[p] = _mm_set1_ps(frustum.planes[p].w);
+		}
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		const __m128i izero = _mm_setzero_si128();
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 radius = _mm_loadu_ps(collider_dimension + i);
+			__m128 neg_radius = _mm_xor_ps(radius, sign);
+			__m128 x = _mm_loadu_ps(location_x + i);
+			__m128 y = _mm_loadu_ps(location_y + i);
+			__m128 z = _mm_add_ps(_mm_loadu_ps(location_z + i), _mm_mul_ps(half, radius));
+
+			__m128 inside = _mm_castsi128_ps(_mm_cmpeq_epi32(izero, izero));
+			for (int p = 0; p < 6; p++)
+			{
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane_x[p], x), _mm_mul_ps(plane_y[p], y)),
+					_mm_add_ps(_mm_mul_ps(plane_z[p], z), plane_w[p]));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, neg_radius));
+			}
+
+			//0xFFFFFFFF/0 lanes down to 1/0 bytes
+			__m128i inside8 = _mm_packs_epi16(_mm_packs_epi32(_mm_castps_si128(inside), izero), izero);
+			int32_t bytes = _mm_cvtsi128_si32(inside8) & 0x01010101;
+			memcpy(visible + i, &bytes, sizeof(bytes));
+
+			for (int mask = _mm_movemask_ps(inside); mask != 0; mask &= mask - 1)
+				visible_count++;
+		}
+
+		for (; i < count; i++)
+		{
+			float r = collider_dimension[i];
+			bool in = frustum.containsSphere(glm::vec3(location_x[i], location_y[i], location_z[i] + 0.5f * r), r);
+			visible[i] = in ? 1 : 0;
+			visible_count += in;
+		}
+		return visible_count;
+	}
+}
+
+#endif // !FRUSTUM_H
@@ -0,0 +1,294 @@
+#ifndef GAME_CLIENT_H
+#define GAME_CLIENT_H
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Connection.h"
+#include "DeltaCodec.h"
+#include "Player.h"
+#include "PlayerSerializer.h"
+#include "Session.h"
+#include "Socket.h"
+#include "WireFormat.h"
+
+namespace sdds
+{
+	//Client side of the game protocol, driven by socket readiness: incoming snapshots are decoded as soon as they
+	//arrive, and the local player is sent every update_interval_ms when it moved or there is a new snapshot to
+	//acknowledge. run() blocks, so it is meant for a thread of its own; nothing in here touches OpenGL.
+	//
+	//The first update goes over TCP as a Msg_Player, which makes the server announce the name. Once the server's
+	//welcome has arrived, locations and acks go over UDP (see Session.h), and so do the server's snapshots.
+	class GameClient
+	{
+		typedef std::chrono::steady_clock clock;
+
+		net::EventLoop loop{};
+		Connection connection{};
+		net::Socket udp{};
+		std::vector<char> datagram{};		//Receive buffer
+		std::vector<char> location_datagram{};
+		DeltaDecoder deltas{};	//Also keeps the names from Msg_Join, by id
+		std::atomic<bool> running{};
+		bool connected{};
+		bool watching_write{};
+		std::string server_address{};
+		uint16_t server_port{};
+		wire::Welcome welcome{};
+		bool welcomed{};
+		uint32_t location_sequence{};
+		Location sent_location{};
+		uint32_t sent_ack{};
+		bool sent_once{};
+		int unchanged_updates{};
+		clock::time_point arrival{};				//Of the frame being handled
+		std::atomic<clock::rep> snapshot_arrival{};	//Of the newest snapshot applied, read by other threads
+
+		enum : uint64_t { Server_Key = 1, Udp_Key = 2 };
+
+		void watchWrite(bool on)
+		{
+			if (on != watching_write)
+			{
+				loop.modify(connection.socket.get(), net::Event_Read | (on ? net::Event_Write : 0), Server_Key);
+				watching_write = on;
+			}
+		}
+
+		bool flush()
+		{
+			net::IoStatus status = connection.flush();
+			if (status == net::Io_Error)
+				return false;
+			watchWrite(connection.wantsWrite());
+			return true;
+		}
+
+		void openUdp()
+		{
+			udp = net::Socket::connectUdp(server_address.c_str(), server_port);
+			if (udp.isOpen() && !loop.add(udp.get(), net::Event_Read, Udp_Key))
+				udp.close();
+			datagram.resize(65536);
+		}
+
+		void sendUpdate(const Player& player, uint32_t ack)
+		{
+			if (sent_once && welcomed && udp.isOpen())
+			{
+				wire::LocationUpdate update{ welcome.id, welcome.token, ++location_sequence, ack, player.location };
+				location_datagram.clear();
+				wire::putLocation(location_datagram, update);
+				//Only the newest location matters, so a datagram that does not make it is simply replaced by the next
+				for (int copy = 0; copy <= redundant_copies; copy++)
+				{
+					size_t sent = 0;
+					udp.send(location_datagram.data(), location_datagram.size(), sent);
+				}
+				return;
+			}
+
+			std::vector<char>& out = connection.outgoing();
+			SerializedPlayer::player_serializer(player, out);
+			if (ack != 0)
+			{
+				size_t at = out.size();
+				out.resize(at + wire::Frame_Header_Size + wire::Max_Varint_Size);
+				out.resize(at + wire::putAckFrame(out.data() + at, ack));
+			}
+		}
+
+	public:
+		int update_interval_ms{ 50 };
+		int redundant_copies{ 0 };	//Extra copies of every location datagram, for links that lose packets
+
+		//Starts connecting to the server. Returns false when that failed straight away.
+		bool connect(const char* address, uint16_t port)
+		{
+			server_address = address;
+			server_port = port;
+			connection = Connection(net::Socket::connectTcp(address, port));
+			if (!connection.socket.isOpen() || !loop.isOpen())
+				return false;
+			connected = false;
+			watching_write = true;	//A non-blocking connect completes when the socket becomes writable
+			return loop.add(connection.socket.get(), net::Event_Read | net::Event_Write, Server_Key);
+		}
+
+		bool isConnected() const { return connected; }
+
+		//True once snapshots and locations go over UDP
+		bool usesUdp() const { return welcomed && udp.isOpen(); }
+
+		//When the frame being handled arrived. Meant for on_player, to timestamp the locations it gets.
+		clock::time_point arrivalTime() const { return arrival; }
+
+		//When the newest snapshot that was applied arrived. Inside on_player that is still the snapshot before the
+		//one being decoded. Can be called from any thread.
+		clock::time_point lastSnapshot() const
+		{
+			return clock::time_point(clock::duration(snapshot_arrival.load(std::memory_order_relaxed)));
+		}
+
+		//Makes run() return within update_interval_ms. Can be called from any thread.
+		void stop()
+		{
+			running.store(false);
+		}
+
+		//Runs until stop() or until the connection is lost. local_player() returns the Player to send;
+		//on_player(const PlayerView&) is called for every remote player that was added or moved, always with the
+		//player's id set, and on_leave(uint32_t id) for every player that left. A player may be reported as left more
+		//than once (by Msg_Leave and by the next delta), or without ever having been reported.
+		//Players are told apart by id only; any number of them may have the same name.
+		template <typename GetLocal, typename OnPlayer, typename OnLeave>
+		void run(GetLocal&& local_player, OnPlayer&& on_player, OnLeave&& on_leave)
+		{
+			running.store(true);
+			clock::time_point next_update = clock::now();
+			auto on_remote = [&](const PlayerView& view)
+			{
+				//The server's snapshots include this client's own player. The welcome comes first on the TCP
+				//connection and UDP is only opened after it, so the id is known before any snapshot arrives.
+				if (view.id != welcome.id)
+					on_player(view);
+			};
+			auto on_position = [&](const QuantizedPlayer& p)
+			{
+				const std::string* name = deltas.knownName(p.id);
+				if (!name)
+					return;	//Not announced yet; the next snapshot has the player again
+				PlayerView view;
+				view.name = name->data();
+				view.name_length = uint32_t(name->size());
+				view.location = p.location();
+				view.id = p.id;
+				on_remote(view);
+			};
+			auto on_departed = [&](uint32_t id)
+			{
+				if (id != welcome.id)
+					on_leave(id);
+			};
+			auto applied = [this]()
+			{
+				snapshot_arrival.store(arrival.time_since_epoch().count(), std::memory_order_relaxed);
+			};
+			auto on_frame = [&](const wire::FrameHeader& header, const char* payload)
+			{
+				arrival = clock::now();
+				switch (header.type)
+				{
+				case wire::Msg_Positions:
+					if (wire::getPositions(payload, header.length, on_position))
+						applied();
+					break;
+				case wire::Msg_Delta:
+					//Over UDP, a delta older than the newest one decoded is dropped here
+					if (deltas.decode(payload, header.length, on_remote, on_departed))
+						applied();
+					break;
+				case wire::Msg_Welcome:
+					if (!welcomed && wire::getWelcome(payload, header.length, welcome))
+					{
+						welcomed = true;
+						openUdp();
+					}
+					break;
+				case wire::Msg_Join:
+				{
+					wire::Join join;
+					PlayerView view;
+					if (!wire::getJoin(payload, header.length, join))
+						break;
+					std::string name(join.name, join.name_length);
+					if (deltas.setName(join.id, name, view.location))
+					{
+						view.name = name.data();
+						view.name_length = uint32_t(name.size());
+						view.id = join.id;
+						on_remote(view);
+					}
+					break;
+				}
+				case wire::Msg_Leave:
+				{
+					uint32_t id;
+					if (wire::getLeave(payload, header.length, id))
+					{
+						deltas.forget(id);
+						on_departed(id);
+					}
+					break;
+				}
+				default:
+					break;
+				}
+			};
+
+			while (running.load())
+			{
+				int timeout = int(std::chrono::duration_cast<std::chrono::milliseconds>(next_update - clock::now()).count());
+				timeout = std::max(0, std::min(timeout, update_interval_ms));
+				bool lost = false;
+				int ready = loop.wait(timeout, [&](uint64_t key, uint32_t events)
+					{
+						if (key == Udp_Key)
+						{
+							//Errors on the UDP socket (e.g. ICMP port unreachable) are not fatal; TCP tells when the server is gone
+							size_t received = 0;
+							net::Address from;
+							while (udp.receiveFrom(datagram.data(), datagram.size(), received, from) == net::Io_Ok)
+								wire::forEachFrame(datagram.data(), received, on_frame);
+							return;
+						}
+						if (!connected && (events & (net::Event_Write | net::Event_Hangup)))
+						{
+							connected = connection.socket.connectResult();
+							if (!connected)
+							{
+								lost = true;
+								return;
+							}
+						}
+						if (events & (net::Event_Read | net::Event_Hangup))
+						{
+							net::IoStatus status = connection.receive(on_frame);
+							if (status == net::Io_Closed || status == net::Io_Error)
+								lost = true;
+						}
+						if (connected && (events & net::Event_Write) && !flush())
+							lost = true;
+					});
+				if (ready < 0 || lost)
+					break;
+
+				if (connected && clock::now() >= next_update)
+				{
+					next_update = clock::now() + std::chrono::milliseconds(update_interval_ms);
+					const Player& player = local_player();
+					uint32_t ack = deltas.latestSequence();
+					bool moved = !sent_once || player.location.x != sent_location.x || player.location.y != sent_location.y ||
+						player.location.z != sent_location.z;
+					//Over UDP the last update may have been lost, so an idle player is still repeated now and then
+					if (!moved && ack == sent_ack && (!usesUdp() || ++unchanged_updates < 10))
+						continue;
+					unchanged_updates = 0;
+
+					sendUpdate(player, ack);
+					sent_location = player.location;
+					sent_ack = ack;
+					sent_once = true;
+					if (!flush())
+						break;
+				}
+			}
+			running.store(false);
+		}
+	};
+}
+
+#endif // !GAME_CLIENT_H
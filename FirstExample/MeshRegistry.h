@@ -0,0 +1,117 @@
+#ifndef MESH_REGISTRY_H
+#define MESH_REGISTRY_H
+#include <cstddef>
+#include <vector>
+#include "vgl.h"
+
+namespace sdds
+{
+	//Static meshes known to the game
+	enum class MeshID
+	{
+		level,	//Ground plane followed by the textured cube
+		count
+	};
+
+	//Uploads every static mesh once, at init time, into its own vertex array object.
+	//Drawing code only binds the VAO (MeshRegistry::bind(MeshID::level)) and issues the draw call; it never
+	//touches the vertex data again. Every buffer upload made through the registry is counted, so the game can check
+	//that nothing is re-uploaded once the level is running.
+	//Meshes are indexed: the element buffer holds triangle strips separated by Restart_Index, which needs
+	//GL_PRIMITIVE_RESTART_FIXED_INDEX to be enabled.
+	class MeshRegistry
+	{
+	public:
+		enum : GLushort { Restart_Index = 0xFFFF };	//Fixed restart index for GL_UNSIGNED_SHORT indices
+
+		struct Mesh
+		{
+			GLuint vao{};
+			GLuint buffers[3]{};	//Positions, texture coordinates, indices
+			GLsizei vertex_count{};
+			GLsizei index_count{};
+		};
+
+	private:
+		static Mesh* meshes()
+		{
+			static Mesh table[size_t(MeshID::count)]{};
+			return table;
+		}
+
+		static size_t& uploads()
+		{
+			static size_t counter = 0;
+			return counter;
+		}
+
+		static void upload(GLenum target, GLuint buffer, GLsizeiptr size, const void* data)
+		{
+			glBindBuffer(target, buffer);
+			glBufferData(target, size, data, GL_STATIC_DRAW);
+			uploads()++;
+		}
+
+	public:
+		//Index list for quads stored as 4 consecutive vertices in GL_QUADS order: every quad becomes a 4 index
+		//triangle strip (v0, v1, v3, v2), and strips are separated by Restart_Index. Yields 5 * quad_count - 1 indices.
+		static std::vector<GLushort> quadStrips(GLushort first_vertex, int quad_count)
+		{
+			std::vector<GLushort> indices;
+			for (int q = 0; q < quad_count; q++)
+			{
+				GLushort v = GLushort(first_vertex + 4 * q);
+				if (q > 0)
+					indices.push_back(Restart_Index);
+				indices.push_back(v);
+				indices.push_back(GLushort(v + 1));
+				indices.push_back(GLushort(v + 3));
+				indices.push_back(GLushort(v + 2));
+			}
+			return indices;
+		}
+
+		//Creates the VAO of a mesh with positions on attribute 0, texture coordinates on attribute 1 and an element buffer.
+		//The VAO stays bound when this returns, so the caller can attach extra attributes to it.
+		static const Mesh& add(MeshID id, const GLfloat(*positions)[3], const GLfloat(*texture_coordinates)[2], GLsizei vertex_count,
+			const GLushort* indices, GLsizei index_count)
+		{
+			Mesh& mesh = meshes()[size_t(id)];
+			mesh.vertex_count = vertex_count;
+			mesh.index_count = index_count;
+			glGenVertexArrays(1, &mesh.vao);
+			glBindVertexArray(mesh.vao);
+			glGenBuffers(3, mesh.buffers);
+
+			upload(GL_ARRAY_BUFFER, mesh.buffers[0], vertex_count * sizeof(GLfloat[3]), positions);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
+			glEnableVertexAttribArray(0);
+
+			upload(GL_ARRAY_BUFFER, mesh.buffers[1], vertex_count * sizeof(GLfloat[2]), texture_coordinates);
+			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
+			glEnableVertexAttribArray(1);
+
+			//The element buffer binding is part of the VAO state
+			upload(GL_ELEMENT_ARRAY_BUFFER, mesh.buffers[2], index_count * sizeof(GLushort), indices);
+			return mesh;
+		}
+
+		static const Mesh& get(MeshID id)
+		{
+			return meshes()[size_t(id)];
+		}
+
+		static void bind(MeshID id)
+		{
+			glBindVertexArray(meshes()[size_t(id)].vao);
+		}
+
+		//Number of buffer uploads made since start-up. Stays constant in steady state.
+		static size_t uploadCount()
+		{
+			return uploads();
+		}
+	};
+}
+
+#endif // !MESH_REGISTRY_H
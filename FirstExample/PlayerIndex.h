@@ -0,0 +1,133 @@
+#ifndef PLAYER_INDEX_H
+#define PLAYER_INDEX_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sdds
+{
+	//Maps the server's player ids to slots of a dense array of players.
+	//Open addressing with linear probing in one flat array of (id, slot) pairs, kept at most half full, so a lookup
+	//hashes the id and usually reads a single cache line. Id 0 is never handed out by the server and marks an empty
+	//entry. Lookups never allocate; insert() may grow the table, which only happens when a player joins.
+	//erase() uses backward-shift deletion instead of tombstones, so a table that sees many joins and leaves keeps
+	//probe runs as short as if the players that left had never been there.
+	class PlayerIndex
+	{
+		struct Entry
+		{
+			uint32_t id{};
+			uint32_t slot{};
+		};
+
+		std::vector<Entry> entries{};
+		uint32_t mask{};
+		uint32_t shift{};
+		size_t count{};
+
+		uint32_t home(uint32_t id) const
+		{
+			return uint32_t((id * 0x9E3779B1u) >> shift);	//Fibonacci hashing: consecutive ids spread over the table
+		}
+
+		void rehash(size_t capacity)
+		{
+			std::vector<Entry> old;
+			old.swap(entries);
+			entries.resize(capacity);
+			mask = uint32_t(capacity - 1);
+			shift = 32;
+			for (size_t c = capacity; c > 1; c >>= 1)
+				shift--;
+			for (const Entry& e : old)
+				if (e.id != 0)
+					place(e);
+		}
+
+		void place(const Entry& entry)
+		{
+			uint32_t at = home(entry.id);
+			while (entries[at].id != 0 && entries[at].id != entry.id)
+				at = (at + 1) & mask;
+			entries[at] = entry;
+		}
+
+	public:
+		enum : uint32_t { Not_Found = 0xFFFFFFFF };
+
+		explicit PlayerIndex(size_t expected_players = 64)
+		{
+			reserve(expected_players);
+		}
+
+		//Makes room for that many players without growing
+		void reserve(size_t players)
+		{
+			size_t capacity = 16;
+			while (capacity < players * 2)
+				capacity *= 2;
+			if (capacity > entries.size())
+				rehash(capacity);
+		}
+
+		//Slot of the player, or Not_Found
+		uint32_t find(uint32_t id) const
+		{
+			if (id == 0)
+				return Not_Found;
+			for (uint32_t at = home(id);; at = (at + 1) & mask)
+			{
+				const Entry& e = entries[at];
+				if (e.id == id)
+					return e.slot;
+				if (e.id == 0)
+					return Not_Found;
+			}
+		}
+
+		//Adds the player, or moves it to another slot when it is already there
+		void insert(uint32_t id, uint32_t slot)
+		{
+			if (id == 0)
+				return;
+			if (find(id) == Not_Found)
+			{
+				if ((count + 1) * 2 > entries.size())
+					rehash(entries.size() * 2);
+				count++;
+			}
+			place(Entry{ id, slot });
+		}
+
+		//Takes the player out and returns the slot it had, or Not_Found. The entries after it in its probe run are
+		//moved back into the hole when their home position allows it, so every remaining id is still found by a
+		//search that stops at the first empty entry.
+		uint32_t erase(uint32_t id)
+		{
+			if (id == 0)
+				return Not_Found;
+			uint32_t hole = home(id);
+			for (; entries[hole].id != id; hole = (hole + 1) & mask)
+				if (entries[hole].id == 0)
+					return Not_Found;
+			uint32_t slot = entries[hole].slot;
+			for (uint32_t at = (hole + 1) & mask; entries[at].id != 0; at = (at + 1) & mask)
+			{
+				//The entry may only move back if the hole is not before its home, going around the table
+				uint32_t from_home = (at - home(entries[at].id)) & mask;
+				if (from_home >= ((at - hole) & mask))
+				{
+					entries[hole] = entries[at];
+					hole = at;
+				}
+			}
+			entries[hole] = Entry{};
+			count--;
+			return slot;
+		}
+
+		size_t size() const { return count; }
+	};
+}
+
+#endif // !PLAYER_INDEX_H
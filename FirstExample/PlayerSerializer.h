@@ -1,47 +1,122 @@
 #ifndef PLAYER_SERIALIZER_H
 #define PLAYER_SERIALIZER_H
-#include <memory>
+#include <string>
+#include <vector>
 #include "Player.h"
+#include "WireFormat.h"
 
 namespace sdds
 {
+	//A player record as it sits in a receive buffer. The name points into the buffer, nothing is copied.
+	struct PlayerView
+	{
+		const char* name{};
+		uint32_t name_length{};
+		Location location{};
+		uint32_t id{};		//The server's id for the player, 0 when not known
+
+		std::string nameString() const
+		{
+			return std::string(name, name_length);
+		}
+
+		bool nameEquals(const std::string& other) const
+		{
+			return other.size() == name_length && other.compare(0, name_length, name, name_length) == 0;
+		}
+	};
+
+	//Player record on the wire (see WireFormat.h for the frame around it):
+	//
+	//    varint name length | name bytes | zigzag varint x | zigzag varint y | zigzag varint z
+	//
+	//Coordinates are quantized to wire::Location_Quantum. A player with a short name inside the 200x200 level
+	//takes about 13 bytes, instead of sizeof(Player) bytes of raw memory. Only the first wire::Max_Name_Length bytes
+	//of a name are sent, so a record always fits into a frame.
 	struct SerializedPlayer
 	{
-		std::unique_ptr<char*> data{};
+		std::vector<char> data{};
 		int size{};
 
+		//Bytes of the name that go on the wire
+		static size_t nameLength(const Player& player)
+		{
+			return player.name.size() < wire::Max_Name_Length ? player.name.size() : size_t(wire::Max_Name_Length);
+		}
+
+		//Upper bound of the bytes encode() writes for this player
+		static size_t maxEncodedSize(const Player& player)
+		{
+			return wire::Max_Varint_Size + nameLength(player) + 3 * wire::Max_Varint_Size;
+		}
+
+		//Writes the record at out (at least maxEncodedSize() bytes) and returns the bytes written
+		static size_t encode(const Player& player, char* out)
+		{
+			char* cursor = out;
+			size_t name_length = nameLength(player);
+			cursor += wire::putVarint(cursor, uint32_t(name_length));
+			player.name.copy(cursor, name_length);
+			cursor += name_length;
+			cursor += wire::putVarint(cursor, wire::zigzag(wire::quantize(player.location.x)));
+			cursor += wire::putVarint(cursor, wire::zigzag(wire::quantize(player.location.y)));
+			cursor += wire::putVarint(cursor, wire::zigzag(wire::quantize(player.location.z)));
+			return size_t(cursor - out);
+		}
+
+		//Decodes one record starting at cursor and moves cursor past it. Returns false on truncated or malformed input.
+		static bool decode(const char*& cursor, const char* end, PlayerView& player)
+		{
+			uint32_t name_length = 0;
+			if (!wire::getVarint(cursor, end, name_length) || name_length > wire::Max_Name_Length ||
+				name_length > size_t(end - cursor))
+				return false;
+			player.name = cursor;
+			player.name_length = name_length;
+			cursor += name_length;
+
+			uint32_t x, y, z;
+			if (!wire::getVarint(cursor, end, x) || !wire::getVarint(cursor, end, y) || !wire::getVarint(cursor, end, z))
+				return false;
+			player.location.x = wire::dequantize(wire::unzigzag(x));
+			player.location.y = wire::dequantize(wire::unzigzag(y));
+			player.location.z = wire::dequantize(wire::unzigzag(z));
+			return true;
+		}
+
+		//Appends a complete Msg_Player frame to out. A send buffer that is reused (cleared, not freed) stops
+		//allocating once it has grown to fit.
+		static void player_serializer(const Player& player, std::vector<char>& out)
+		{
+			size_t at = out.size();
+			out.resize(at + wire::Frame_Header_Size + maxEncodedSize(player));
+			size_t payload = encode(player, out.data() + at + wire::Frame_Header_Size);
+			wire::putFrameHeader(out.data() + at, uint16_t(payload), wire::Msg_Player);
+			out.resize(at + wire::Frame_Header_Size + payload);
+		}
+
+		//Builds a complete Msg_Player frame, ready to be sent
 		static SerializedPlayer player_serializer(const Player& player)
 		{
 			SerializedPlayer sp{};
-			sp.size = sizeof(Player);
-			size_t name_size = player.name.length();
-			sp.data = std::make_unique<char*>(new char[sp.size]);
-			char* auxptr = *sp.data;
-			memcpy(auxptr, &name_size, sizeof(size_t));
-			auxptr += sizeof(size_t);
-			memcpy(auxptr, player.name.c_str(), player.name.size());
-			auxptr += player.name.size();
-			memcpy(auxptr, &player.location, sizeof(Location));
+			player_serializer(player, sp.data);
+			sp.size = int(sp.data.size());
 			return sp;
 		};
 
-
-		static Player player_deserializer(const char* auxptr)
+		//Decodes the payload of a Msg_Player frame into an owning Player. The name is copied into the Player's own
+		//string, so a Player that is decoded into again and again allocates only when a longer name comes along.
+		static bool player_deserializer(const char* payload, size_t length, Player& player)
 		{
-			Player player{};
-			size_t name_size = 0;
-			memcpy(&name_size, auxptr, sizeof(size_t));
-			auxptr += sizeof(size_t);
-			std::unique_ptr<char*> name = std::make_unique<char*>(new char[name_size]);
-			memcpy(*name, auxptr, name_size);
-			auto s_name = std::string(*name, name_size);
-			player.name = s_name;
-			auxptr += name_size;
-			memcpy(&player.location, auxptr, sizeof(Location));
-			return player;
+			PlayerView view;
+			const char* cursor = payload;
+			if (!decode(cursor, payload + length, view))
+				return false;
+			player.name.assign(view.name, view.name_length);
+			player.location = view.location;
+			return true;
 		};
 	};
 }
 
 #endif // !PLAYER_SERIALIZER_H
-
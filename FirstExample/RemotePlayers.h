@@ -0,0 +1,161 @@
+#ifndef REMOTE_PLAYERS_H
+#define REMOTE_PLAYERS_H
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Player.h"
+#include "PlayerIndex.h"
+#include "PlayerSerializer.h"
+#include "SnapshotInterpolator.h"
+#include "SpscQueue.h"
+
+namespace sdds
+{
+	//A remote player as the main thread keeps it: the latest location received, and the motion drawn from them
+	struct RemotePlayer
+	{
+		uint32_t id{};		//The server's id, to re-point the index when the player changes slots
+		Player player{};
+		SnapshotInterpolator motion{};
+	};
+
+	//A location received for a remote player, on its way from the network thread to the main thread; or, with left
+	//set, the news that the player is gone
+	struct RemoteUpdate
+	{
+		uint32_t id{};
+		bool left{};
+		std::string name{};
+		Location location{};
+		std::chrono::steady_clock::time_point arrival{};
+		std::chrono::steady_clock::time_point previous_snapshot{};
+	};
+
+	//The remote players and the way their updates take from the network thread to the main thread.
+	//The network thread writes updates in place into the slots of an SpscQueue, so once the slots' names have grown
+	//to fit, passing an update allocates nothing. Updates the queue has no room for wait in order in a backlog
+	//until the main thread catches up; only a main thread that falls far behind makes that allocate.
+	//The main thread drains the queue into a dense array of players, found by id through a PlayerIndex. A player
+	//gets a slot when it joins and gives it up with a swap-remove when it leaves.
+	class RemotePlayers
+	{
+	public:
+		enum : size_t { Queue_Capacity = 4096 };
+
+	private:
+		SpscQueue<RemoteUpdate, Queue_Capacity> updates{};	//Network thread -> main thread
+		std::vector<RemoteUpdate> backlog{};				//Owned by the network thread
+		std::vector<RemotePlayer> players{};				//Owned by the main thread
+		PlayerIndex slots{};								//Server's player id -> index into players
+
+		//A queue slot to fill, or the back of the backlog when the queue is full or the backlog is not empty yet.
+		//Returns whether the slot has to be published.
+		bool nextUpdate(RemoteUpdate*& update)
+		{
+			flush();
+			update = backlog.empty() ? updates.claim() : nullptr;
+			if (update)
+				return true;
+			backlog.emplace_back();
+			update = &backlog.back();
+			return false;
+		}
+
+		void remove(uint32_t id)
+		{
+			uint32_t slot = slots.erase(id);
+			if (slot == PlayerIndex::Not_Found)
+				return;
+			//Swap-remove: the last player moves into the freed slot and its index entry follows it
+			if (slot != players.size() - 1)
+			{
+				players[slot] = std::move(players.back());
+				slots.insert(players[slot].id, slot);
+			}
+			players.pop_back();
+		}
+
+	public:
+		//Network thread. Moves what it can of the backlog into the queue; call it regularly, so the backlog also
+		//drains while nothing arrives.
+		void flush()
+		{
+			size_t sent = 0;
+			for (RemoteUpdate* slot; sent < backlog.size() && (slot = updates.claim()) != nullptr; sent++)
+			{
+				*slot = backlog[sent];
+				updates.publish();
+			}
+			backlog.erase(backlog.begin(), backlog.begin() + sent);
+		}
+
+		//Network thread. A location received for a player, with the arrival time of its snapshot and of the one
+		//before.
+		void onPlayer(const PlayerView& view, std::chrono::steady_clock::time_point arrival,
+			std::chrono::steady_clock::time_point previous_snapshot)
+		{
+			RemoteUpdate* update;
+			bool queued = nextUpdate(update);
+			//Written in place: the slot's name keeps its capacity from earlier updates, so nothing is allocated
+			update->id = view.id;
+			update->left = false;
+			update->name.assign(view.name, view.name_length);
+			update->location = view.location;
+			update->arrival = arrival;
+			update->previous_snapshot = previous_snapshot;
+			if (queued)
+				updates.publish();
+		}
+
+		//Network thread
+		void onLeave(uint32_t id)
+		{
+			RemoteUpdate* update;
+			bool queued = nextUpdate(update);
+			update->id = id;
+			update->left = true;
+			if (queued)
+				updates.publish();
+		}
+
+		//Main thread. Applies the updates that have arrived and calls on_update(RemotePlayer&) for every player
+		//that got a new location.
+		template <typename F>
+		void apply(F&& on_update)
+		{
+			//Read in place, so the queue's slots keep their memory for the network thread
+			while (const RemoteUpdate* update = updates.front())
+			{
+				if (update->left)
+				{
+					remove(update->id);
+					updates.release();
+					continue;
+				}
+
+				uint32_t slot = slots.find(update->id);
+				if (slot == PlayerIndex::Not_Found)
+				{
+					//Joined: the only time the player gets a slot
+					slot = uint32_t(players.size());
+					players.emplace_back();
+					players[slot].id = update->id;
+					players[slot].player.name = update->name;
+					slots.insert(update->id, slot);
+				}
+				RemotePlayer& remote = players[slot];
+				remote.player.location = update->location;
+				remote.motion.push(update->arrival, update->location, update->previous_snapshot);
+				on_update(remote);
+				updates.release();
+			}
+		}
+
+		//Main thread
+		const std::vector<RemotePlayer>& all() const { return players; }
+	};
+}
+
+#endif // !REMOTE_PLAYERS_H
@@ -0,0 +1,68 @@
+#ifndef RENDER_SNAPSHOT_H
+#define RENDER_SNAPSHOT_H
+#include <chrono>
+#include <vector>
+#include "glm\glm.hpp"
+#include "SceneStore.h"
+
+namespace sdds
+{
+	//Immutable copy of what the renderer needs from the scene, published by the simulation thread after every
+	//simulation step. Only live objects are copied. The arrays are reused from one snapshot to the next, so
+	//capturing does not allocate once the scene has reached its size.
+	struct RenderSnapshot
+	{
+		std::vector<float> location_x{};
+		std::vector<float> location_y{};
+		std::vector<float> location_z{};
+		std::vector<float> collider_dimension{};
+		std::vector<glm::vec3> previous_location{};	//Location one step earlier, for interpolation
+		std::vector<glm::vec3> scale{};
+		std::vector<int> type{};
+		std::chrono::steady_clock::time_point time{};	//When the state was produced
+		float step_ms{};								//Length of the simulation step
+
+		size_t size() const { return location_x.size(); }
+
+		//How far the renderer is between previous_location and location at the given time, in [0, 1]
+		float alpha(std::chrono::steady_clock::time_point now) const
+		{
+			if (step_ms <= 0.0f)
+				return 1.0f;
+			float a = std::chrono::duration<float, std::milli>(now - time).count() / step_ms;
+			return glm::clamp(a, 0.0f, 1.0f);
+		}
+
+		glm::vec3 interpolatedLocation(size_t i, float a) const
+		{
+			return glm::mix(previous_location[i], glm::vec3(location_x[i], location_y[i], location_z[i]), a);
+		}
+
+		void capture(const SceneStore& scene, float step)
+		{
+			location_x.clear();
+			location_y.clear();
+			location_z.clear();
+			collider_dimension.clear();
+			previous_location.clear();
+			scale.clear();
+			type.clear();
+			for (size_t i = 0; i < scene.size(); i++)
+			{
+				if (!scene.alive[i])
+					continue;
+				location_x.push_back(scene.location_x[i]);
+				location_y.push_back(scene.location_y[i]);
+				location_z.push_back(scene.location_z[i]);
+				collider_dimension.push_back(scene.collider_dimension[i]);
+				previous_location.push_back(glm::vec3(scene.previous_x[i], scene.previous_y[i], scene.previous_z[i]));
+				scale.push_back(scene.scale[i]);
+				type.push_back(scene.type[i]);
+			}
+			time = std::chrono::steady_clock::now();
+			step_ms = step;
+		}
+	};
+}
+
+#endif // !RENDER_SNAPSHOT_H
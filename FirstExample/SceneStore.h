@@ -0,0 +1,332 @@
+#ifndef SCENE_STORE_H
+#define SCENE_STORE_H
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "glm\glm.hpp"
+#include "BatchIntegrator.h"
+
+namespace sdds
+{
+	//Added on Nov. 21 2021 by: Alireza Moghaddam
+	enum GameObject_Type {
+		PLAYER,
+		ENEMY,
+		BULLET,
+		OBSTACLE
+	};
+
+	//Description of a single object. The scene does not store these records, it is only used to spawn objects
+	//and to read one back as a whole (see SceneStore::get()).
+	struct GameObject {
+
+		glm::vec3 location{};
+		glm::vec3 rotation{};
+		glm::vec3 scale{};
+		glm::vec3 moving_direction{};
+		float velocity{};
+		float collider_dimension{}; //We use box as wrapper with radius = 0.9 * scale of the object Note: 0.9 is the original dimension of the boxes we generate
+		int living_time{};
+		int life_span{};		//In this code, the life span for obstacles is set to a negative value (Just so that they remain in the scene during the game)
+		int type{};
+		bool isAlive{};
+		bool isCollided{};
+
+	};
+	//End of fragment added
+
+	//Structure-of-arrays storage for the scene graph.
+	//Each field lives in its own contiguous array, so a pass only pulls the fields it reads into the cache and the
+	//integrator can process several objects per instruction.
+	//
+	//The arrays are dense: index i of every array is the same object, and dead objects are swapped out by compact().
+	//Because compaction moves objects around, code outside the store refers to an object through a Handle, which
+	//names a slot in an indirection table. A slot is recycled through a free list once its object is compacted away,
+	//and its generation is bumped so stale handles to the old object stop resolving.
+	class SceneStore
+	{
+	public:
+		struct Handle
+		{
+			uint32_t slot{};
+			uint32_t generation{};
+		};
+
+		enum : uint32_t { Invalid_Index = 0xFFFFFFFFu };
+
+		//Hot fields, touched every tick
+		std::vector<float> location_x{};
+		std::vector<float> location_y{};
+		std::vector<float> location_z{};
+		std::vector<float> previous_x{};	//Location before the last update(), for render interpolation
+		std::vector<float> previous_y{};
+		std::vector<float> previous_z{};
+		std::vector<float> direction_x{};	//Normalized once at spawn time
+		std::vector<float> direction_y{};
+		std::vector<float> direction_z{};
+		std::vector<float> velocity{};
+		std::vector<float> living_time{};
+		std::vector<float> life_span{};
+		std::vector<uint8_t> alive{};
+		std::vector<uint8_t> expired{};		//Set for the objects that died during the last update()
+
+		//Cold fields, used by collision and rendering
+		std::vector<int> type{};
+		std::vector<uint8_t> collided{};
+		std::vector<float> collider_dimension{};
+		std::vector<glm::vec3> rotation{};
+		std::vector<glm::vec3> scale{};
+
+		//Slot bookkeeping
+		std::vector<uint32_t> dense_slot{};		//Dense index -> slot
+		std::vector<uint32_t> slot_index{};		//Slot -> dense index (Invalid_Index when the slot is free)
+		std::vector<uint32_t> slot_generation{};
+		std::vector<uint32_t> free_slots{};
+		size_t dead_count{};					//Dead objects still waiting for compact()
+
+		//Lightweight view of one object inside the store, addressed by dense index
+		class ObjectRef
+		{
+			SceneStore* store{};
+			uint32_t index{};
+		public:
+			ObjectRef(SceneStore* s, uint32_t i) : store(s), index(i) {}
+			uint32_t id() const { return index; }
+			Handle handle() const { return store->handleOf(index); }
+			glm::vec3 location() const { return glm::vec3(store->location_x[index], store->location_y[index], store->location_z[index]); }
+			glm::vec3 previousLocation() const { return glm::vec3(store->previous_x[index], store->previous_y[index], store->previous_z[index]); }
+			//Location between the last two updates; alpha = 0 is the previous state, alpha = 1 the current one
+			glm::vec3 interpolatedLocation(float alpha) const { return glm::mix(previousLocation(), location(), alpha); }
+			const glm::vec3& scale() const { return store->scale[index]; }
+			float colliderDimension() const { return store->collider_dimension[index]; }
+			int type() const { return store->type[index]; }
+			bool isAlive() const { return store->alive[index] != 0; }
+			bool isCollided() const { return store->collided[index] != 0; }
+		};
+
+		class iterator
+		{
+			SceneStore* store{};
+			uint32_t index{};
+		public:
+			iterator(SceneStore* s, uint32_t i) : store(s), index(i) {}
+			ObjectRef operator*() const { return ObjectRef(store, index); }
+			iterator& operator++() { index++; return *this; }
+			bool operator!=(const iterator& other) const { return index != other.index; }
+		};
+
+		iterator begin() { return iterator(this, 0); }
+		iterator end() { return iterator(this, uint32_t(size())); }
+		ObjectRef operator[](uint32_t i) { return ObjectRef(this, i); }
+		size_t size() const { return location_x.size(); }
+		size_t liveCount() const { return size() - dead_count; }
+		size_t deadCount() const { return dead_count; }
+
+		Handle handleOf(uint32_t i) const
+		{
+			return Handle{ dense_slot[i], slot_generation[dense_slot[i]] };
+		}
+
+		//Dense index of the object behind a handle, or Invalid_Index if the object has been compacted away
+		uint32_t indexOf(Handle h) const
+		{
+			if (h.slot >= slot_index.size() || slot_generation[h.slot] != h.generation)
+				return Invalid_Index;
+			return slot_index[h.slot];
+		}
+
+		bool isValid(Handle h) const
+		{
+			return indexOf(h) != Invalid_Index;
+		}
+
+		//O(1): takes a slot from the free list (or a new one) and appends the object to the dense arrays
+		Handle spawn(const GameObject& go)
+		{
+			uint32_t slot;
+			if (!free_slots.empty())
+			{
+				slot = free_slots.back();
+				free_slots.pop_back();
+			}
+			else
+			{
+				slot = uint32_t(slot_index.size());
+				slot_index.push_back(Invalid_Index);
+				slot_generation.push_back(0);
+			}
+			slot_index[slot] = uint32_t(size());
+			dense_slot.push_back(slot);
+
+			glm::vec3 dir = go.moving_direction;
+			if (glm::dot(dir, dir) > 0.0f)
+				dir = glm::normalize(dir);
+
+			location_x.push_back(go.location.x);
+			location_y.push_back(go.location.y);
+			location_z.push_back(go.location.z);
+			previous_x.push_back(go.location.x);
+			previous_y.push_back(go.location.y);
+			previous_z.push_back(go.location.z);
+			direction_x.push_back(dir.x);
+			direction_y.push_back(dir.y);
+			direction_z.push_back(dir.z);
+			velocity.push_back(go.velocity);
+			living_time.push_back(float(go.living_time));
+			life_span.push_back(float(go.life_span));
+			alive.push_back(go.isAlive ? 1 : 0);
+			expired.push_back(0);
+			type.push_back(go.type);
+			collided.push_back(go.isCollided ? 1 : 0);
+			collider_dimension.push_back(go.collider_dimension);
+			rotation.push_back(go.rotation);
+			scale.push_back(go.scale);
+			if (!go.isAlive)
+				dead_count++;
+			return Handle{ slot, slot_generation[slot] };
+		}
+
+		//O(1): marks the object dead. Its storage is reclaimed by the next compact().
+		void despawn(Handle handle)
+		{
+			uint32_t i = indexOf(handle);
+			if (i == Invalid_Index || !alive[i])
+				return;
+			alive[i] = 0;
+			dead_count++;
+		}
+
+		//Swap-and-pop removal of every dead object. The last object is moved into the hole, so iteration cost
+		//afterwards only depends on the number of live objects. on_remove(slot) is called for every slot released.
+		template <typename F>
+		void compact(F&& on_remove)
+		{
+			uint32_t i = 0;
+			while (i < size())
+			{
+				if (alive[i])
+				{
+					i++;
+					continue;
+				}
+
+				uint32_t slot = dense_slot[i];
+				uint32_t last = uint32_t(size() - 1);
+				if (i != last)
+					moveObject(last, i);
+				popBack();
+
+				slot_index[slot] = Invalid_Index;
+				slot_generation[slot]++;
+				free_slots.push_back(slot);
+				on_remove(slot);
+			}
+			dead_count = 0;
+		}
+
+		void compact()
+		{
+			compact([](uint32_t) {});
+		}
+
+		//Gathers every field of one object back into a GameObject record (slow path, not meant for per-frame loops)
+		GameObject get(Handle handle) const
+		{
+			uint32_t h = indexOf(handle);
+			GameObject go;
+			if (h == Invalid_Index)
+				return go;
+			go.location = glm::vec3(location_x[h], location_y[h], location_z[h]);
+			go.rotation = rotation[h];
+			go.scale = scale[h];
+			go.moving_direction = glm::vec3(direction_x[h], direction_y[h], direction_z[h]);
+			go.velocity = velocity[h];
+			go.collider_dimension = collider_dimension[h];
+			go.living_time = int(living_time[h]);
+			go.life_span = int(life_span[h]);
+			go.type = type[h];
+			go.isAlive = alive[h] != 0;
+			go.isCollided = collided[h] != 0;
+			return go;
+		}
+
+		//Advances the whole scene by dt milliseconds: every living, mortal object either expires or moves along its
+		//direction and ages by dt. Obstacles have a negative life span and are never touched.
+		//The work is done by the widest batch integrator the CPU supports. Returns the number of objects that expired.
+		size_t update(float dt)
+		{
+			std::copy(location_x.begin(), location_x.end(), previous_x.begin());
+			std::copy(location_y.begin(), location_y.end(), previous_y.begin());
+			std::copy(location_z.begin(), location_z.end(), previous_z.begin());
+
+			IntegratorBatch batch;
+			batch.location_x = location_x.data();
+			batch.location_y = location_y.data();
+			batch.location_z = location_z.data();
+			batch.direction_x = direction_x.data();
+			batch.direction_y = direction_y.data();
+			batch.direction_z = direction_z.data();
+			batch.velocity = velocity.data();
+			batch.living_time = living_time.data();
+			batch.life_span = life_span.data();
+			batch.alive = alive.data();
+			batch.expired = expired.data();
+			batch.count = size();
+			size_t expired_now = selectIntegrator()(batch, dt);
+			dead_count += expired_now;
+			return expired_now;
+		}
+
+	private:
+		void moveObject(uint32_t from, uint32_t to)
+		{
+			location_x[to] = location_x[from];
+			location_y[to] = location_y[from];
+			location_z[to] = location_z[from];
+			previous_x[to] = previous_x[from];
+			previous_y[to] = previous_y[from];
+			previous_z[to] = previous_z[from];
+			direction_x[to] = direction_x[from];
+			direction_y[to] = direction_y[from];
+			direction_z[to] = direction_z[from];
+			velocity[to] = velocity[from];
+			living_time[to] = living_time[from];
+			life_span[to] = life_span[from];
+			alive[to] = alive[from];
+			expired[to] = expired[from];
+			type[to] = type[from];
+			collided[to] = collided[from];
+			collider_dimension[to] = collider_dimension[from];
+			rotation[to] = rotation[from];
+			scale[to] = scale[from];
+			dense_slot[to] = dense_slot[from];
+			slot_index[dense_slot[to]] = to;
+		}
+
+		void popBack()
+		{
+			location_x.pop_back();
+			location_y.pop_back();
+			location_z.pop_back();
+			previous_x.pop_back();
+			previous_y.pop_back();
+			previous_z.pop_back();
+			direction_x.pop_back();
+			direction_y.pop_back();
+			direction_z.pop_back();
+			velocity.pop_back();
+			living_time.pop_back();
+			life_span.pop_back();
+			alive.pop_back();
+			expired.pop_back();
+			type.pop_back();
+			collided.pop_back();
+			collider_dimension.pop_back();
+			rotation.pop_back();
+			scale.pop_back();
+			dense_slot.pop_back();
+		}
+	};
+}
+
+#endif // !SCENE_STORE_H
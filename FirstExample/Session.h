@@ -0,0 +1,184 @@
+#ifndef SESSION_H
+#define SESSION_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Player.h"
+#include "WireFormat.h"
+
+namespace sdds
+{
+	//Session messages. The TCP connection carries what must arrive: the welcome, players joining (with their
+	//names) and leaving. Locations go over UDP, where a lost datagram does not hold up the ones behind it:
+	//Msg_Location from the client, Msg_Delta snapshots from the server. Every datagram holds one or more complete
+	//frames. Both kinds of datagram carry sequence numbers, so anything older than what was already applied is
+	//dropped, and no datagram depends on an earlier one having arrived.
+	//
+	//    Msg_Welcome:  varint player id | u32 token
+	//    Msg_Join:     varint player id | varint name length | name
+	//    Msg_Leave:    varint player id
+	//    Msg_Location: varint player id | u32 token | varint sequence | varint acked snapshot |
+	//                  zigzag varint x | zigzag varint y | zigzag varint z
+	//
+	//The token from the welcome proves that a datagram comes from the client holding that TCP connection; the
+	//server takes the datagram's source address as the client's UDP address.
+	namespace wire
+	{
+		enum : uint8_t
+		{
+			Msg_Welcome = 5,
+			Msg_Join = 6,
+			Msg_Leave = 7,
+			Msg_Location = 8,
+		};
+
+		//Largest datagram sent. Bigger than an Ethernet MTU (the IP layer fragments), but below the UDP limit.
+		enum : size_t { Max_Datagram_Size = 60000 };
+
+		//Wraparound-safe "a is newer than b" for sequence numbers
+		inline bool isNewer(uint32_t a, uint32_t b)
+		{
+			return int32_t(a - b) > 0;
+		}
+
+		struct Welcome
+		{
+			uint32_t id{};
+			uint32_t token{};
+		};
+
+		struct Join
+		{
+			uint32_t id{};
+			const char* name{};		//Points into the payload
+			uint32_t name_length{};
+		};
+
+		struct LocationUpdate
+		{
+			uint32_t id{};
+			uint32_t token{};
+			uint32_t sequence{};
+			uint32_t ack{};
+			Location location{};
+		};
+
+		//The put functions append a whole frame to out
+		inline void putWelcome(std::vector<char>& out, const Welcome& welcome)
+		{
+			size_t at = out.size();
+			out.resize(at + Frame_Header_Size + Max_Varint_Size + 4);
+			char* payload = out.data() + at + Frame_Header_Size;
+			size_t length = putVarint(payload, welcome.id);
+			putU32(payload + length, welcome.token);
+			length += 4;
+			putFrameHeader(out.data() + at, uint16_t(length), Msg_Welcome);
+			out.resize(at + Frame_Header_Size + length);
+		}
+
+		inline bool getWelcome(const char* payload, size_t length, Welcome& welcome)
+		{
+			const char* cursor = payload;
+			const char* end = payload + length;
+			if (!getVarint(cursor, end, welcome.id) || end - cursor < 4)
+				return false;
+			welcome.token = getU32(cursor);
+			return true;
+		}
+
+		inline void putJoin(std::vector<char>& out, uint32_t id, const std::string& name)
+		{
+			size_t at = out.size();
+			out.resize(at + Frame_Header_Size + 2 * Max_Varint_Size + name.size());
+			char* payload = out.data() + at + Frame_Header_Size;
+			size_t length = putVarint(payload, id);
+			length += putVarint(payload + length, uint32_t(name.size()));
+			name.copy(payload + length, name.size());
+			length += name.size();
+			putFrameHeader(out.data() + at, uint16_t(length), Msg_Join);
+			out.resize(at + Frame_Header_Size + length);
+		}
+
+		inline bool getJoin(const char* payload, size_t length, Join& join)
+		{
+			const char* cursor = payload;
+			const char* end = payload + length;
+			if (!getVarint(cursor, end, join.id) || !getVarint(cursor, end, join.name_length) || join.name_length > size_t(end - cursor))
+				return false;
+			join.name = cursor;
+			return true;
+		}
+
+		inline void putLeave(std::vector<char>& out, uint32_t id)
+		{
+			size_t at = out.size();
+			out.resize(at + Frame_Header_Size + Max_Varint_Size);
+			size_t length = putVarint(out.data() + at + Frame_Header_Size, id);
+			putFrameHeader(out.data() + at, uint16_t(length), Msg_Leave);
+			out.resize(at + Frame_Header_Size + length);
+		}
+
+		inline bool getLeave(const char* payload, size_t length, uint32_t& id)
+		{
+			const char* cursor = payload;
+			return getVarint(cursor, payload + length, id);
+		}
+
+		inline void putLocation(std::vector<char>& out, const LocationUpdate& update)
+		{
+			size_t at = out.size();
+			out.resize(at + Frame_Header_Size + 6 * Max_Varint_Size + 4);
+			char* payload = out.data() + at + Frame_Header_Size;
+			char* cursor = payload;
+			cursor += putVarint(cursor, update.id);
+			putU32(cursor, update.token);
+			cursor += 4;
+			cursor += putVarint(cursor, update.sequence);
+			cursor += putVarint(cursor, update.ack);
+			cursor += putVarint(cursor, zigzag(quantize(update.location.x)));
+			cursor += putVarint(cursor, zigzag(quantize(update.location.y)));
+			cursor += putVarint(cursor, zigzag(quantize(update.location.z)));
+			size_t length = size_t(cursor - payload);
+			putFrameHeader(out.data() + at, uint16_t(length), Msg_Location);
+			out.resize(at + Frame_Header_Size + length);
+		}
+
+		inline bool getLocation(const char* payload, size_t length, LocationUpdate& update)
+		{
+			const char* cursor = payload;
+			const char* end = payload + length;
+			if (!getVarint(cursor, end, update.id) || end - cursor < 4)
+				return false;
+			update.token = getU32(cursor);
+			cursor += 4;
+			uint32_t x, y, z;
+			if (!getVarint(cursor, end, update.sequence) || !getVarint(cursor, end, update.ack) ||
+				!getVarint(cursor, end, x) || !getVarint(cursor, end, y) || !getVarint(cursor, end, z))
+				return false;
+			update.location.x = dequantize(unzigzag(x));
+			update.location.y = dequantize(unzigzag(y));
+			update.location.z = dequantize(unzigzag(z));
+			return true;
+		}
+
+		//Calls on_frame(const FrameHeader&, const char* payload) for every complete frame of a datagram.
+		//Returns false when the datagram ends in a truncated frame.
+		template <typename F>
+		bool forEachFrame(const char* data, size_t length, F&& on_frame)
+		{
+			FrameHeader header;
+			while (getFrameHeader(data, length, header))
+			{
+				if (length - Frame_Header_Size < header.length)
+					return false;
+				if (header.version == Protocol_Version)
+					on_frame(static_cast<const FrameHeader&>(header), data + Frame_Header_Size);
+				data += Frame_Header_Size + header.length;
+				length -= Frame_Header_Size + header.length;
+			}
+			return length == 0;
+		}
+	}
+}
+
+#endif // !SESSION_H
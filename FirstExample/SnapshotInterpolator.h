@@ -0,0 +1,126 @@
+#ifndef SNAPSHOT_INTERPOLATOR_H
+#define SNAPSHOT_INTERPOLATOR_H
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include "Player.h"
+
+namespace sdds
+{
+	//Smooth motion for a remote player. Every location received for the player goes into a small ring together with
+	//the time it arrived; the renderer asks for the location at (now - delay), which normally lies between two
+	//received samples and is interpolated. When the samples run out (a late or lost snapshot), the last velocity is
+	//extrapolated for at most max_extrapolation and the player then waits where it got to.
+	//
+	//Deltas only carry the players that moved, so a snapshot that does not mention a player still says the player
+	//stood still. That is why push() and sample() take the arrival time of a snapshot: a player with no sample since
+	//then is held at its last location instead of being extrapolated past where it stopped, and a player that starts
+	//moving after standing still does not glide from the last sample it had, long ago.
+	//
+	//Times are arrival times on this machine, so network jitter shows up in them; the delay has to cover it.
+	class SnapshotInterpolator
+	{
+	public:
+		typedef std::chrono::steady_clock clock;
+
+		struct Settings
+		{
+			clock::duration delay{ std::chrono::milliseconds(100) };
+			clock::duration max_extrapolation{ std::chrono::milliseconds(250) };
+		};
+
+		enum : size_t { Ring_Size = 16 };
+
+	private:
+		struct Sample
+		{
+			clock::time_point time{};
+			Location location{};
+		};
+
+		Sample samples[Ring_Size]{};
+		size_t newest{};
+		size_t count{};
+
+		const Sample& at(size_t age) const	//0 is the newest sample
+		{
+			return samples[(newest + Ring_Size - age) % Ring_Size];
+		}
+
+		void append(clock::time_point time, const Location& location)
+		{
+			if (count > 0 && time <= at(0).time)
+			{
+				samples[newest].location = location;	//Same instant (e.g. a join after a snapshot): the newer value wins
+				return;
+			}
+			newest = (newest + 1) % Ring_Size;
+			samples[newest] = Sample{ time, location };
+			count = std::min(count + 1, size_t(Ring_Size));
+		}
+
+		static Location lerp(const Location& a, const Location& b, float t)
+		{
+			return Location{ a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t };
+		}
+
+		static float ratio(clock::duration part, clock::duration whole)
+		{
+			return whole.count() > 0 ? float(double(part.count()) / double(whole.count())) : 0.0f;
+		}
+
+	public:
+		bool empty() const { return count == 0; }
+
+		//Newest location received
+		Location latest() const { return count > 0 ? at(0).location : Location{}; }
+
+		//Records the location a snapshot arriving at time gave the player. previous_snapshot is when the snapshot
+		//before that one arrived; the player was still at its last location then.
+		void push(clock::time_point time, const Location& location, clock::time_point previous_snapshot)
+		{
+			if (count > 0 && previous_snapshot > at(0).time && previous_snapshot < time)
+				append(previous_snapshot, at(0).location);
+			append(time, location);
+		}
+
+		//Location to draw at now. latest_snapshot is when the newest snapshot arrived.
+		Location sample(clock::time_point now, clock::time_point latest_snapshot, const Settings& settings) const
+		{
+			if (count == 0)
+				return Location{};
+			clock::time_point render_time = now - settings.delay;
+
+			//A snapshot newer than the last sample confirms the player did not move: a virtual sample at the front
+			Sample front = at(0);
+			Sample before = count > 1 ? at(1) : front;
+			size_t first_pair = 1;	//Age of the newer sample of the first pair the loop below looks at
+			if (latest_snapshot > front.time)
+			{
+				before = front;
+				front.time = latest_snapshot;
+				first_pair = 0;
+			}
+
+			if (render_time >= front.time)
+			{
+				//Ran out of samples: dead reckoning from the last two, for a limited time
+				clock::duration ahead = std::min(render_time - front.time, settings.max_extrapolation);
+				return lerp(before.location, front.location, 1.0f + ratio(ahead, front.time - before.time));
+			}
+			if (render_time >= before.time)
+				return lerp(before.location, front.location, ratio(render_time - before.time, front.time - before.time));
+
+			for (size_t age = first_pair; age + 1 < count; age++)
+			{
+				const Sample& newer = at(age);
+				const Sample& older = at(age + 1);
+				if (render_time >= older.time)
+					return lerp(older.location, newer.location, ratio(render_time - older.time, newer.time - older.time));
+			}
+			return at(count - 1).location;	//Older than anything kept
+		}
+	};
+}
+
+#endif // !SNAPSHOT_INTERPOLATOR_H
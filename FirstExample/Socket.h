@@ -0,0 +1,466 @@
+#ifndef SOCKET_H
+#define SOCKET_H
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+#endif
+
+namespace sdds
+{
+	//Thin platform layer over Winsock and BSD sockets. Sockets are non-blocking; send and receive report
+	//Io_WouldBlock instead of waiting, and EventLoop tells when it is worth trying again.
+	namespace net
+	{
+#ifdef _WIN32
+		typedef SOCKET socket_t;
+		const socket_t Invalid_Socket = INVALID_SOCKET;
+#else
+		typedef int socket_t;
+		const socket_t Invalid_Socket = -1;
+#endif
+
+		typedef sockaddr_in Address;
+
+		//IPv4 address in dotted notation and port
+		inline bool makeAddress(const char* address, uint16_t port, Address& out)
+		{
+			out = Address{};
+			out.sin_family = AF_INET;
+			out.sin_port = htons(port);
+			return inet_pton(AF_INET, address, &out.sin_addr) == 1;
+		}
+
+		inline bool sameAddress(const Address& a, const Address& b)
+		{
+			return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+		}
+
+		enum IoStatus
+		{
+			Io_Ok,
+			Io_WouldBlock,
+			Io_Closed,	//Orderly shutdown by the peer
+			Io_Error,
+		};
+
+		//Winsock needs WSAStartup before any other call; elsewhere this does nothing. Call once per process.
+		inline bool startup()
+		{
+#ifdef _WIN32
+			WSADATA wsaData;
+			return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+			return true;
+#endif
+		}
+
+		inline void cleanup()
+		{
+#ifdef _WIN32
+			WSACleanup();
+#endif
+		}
+
+		inline bool wouldBlock()
+		{
+#ifdef _WIN32
+			int error = WSAGetLastError();
+			return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS;
+#else
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS || errno == EINTR;
+#endif
+		}
+
+		//Owning socket handle, closed on destruction. Move-only.
+		class Socket
+		{
+			socket_t handle{ Invalid_Socket };
+
+		public:
+			Socket() = default;
+			explicit Socket(socket_t s) : handle(s) {}
+			Socket(const Socket&) = delete;
+			Socket& operator=(const Socket&) = delete;
+			Socket(Socket&& other) noexcept : handle(other.handle) { other.handle = Invalid_Socket; }
+			Socket& operator=(Socket&& other) noexcept
+			{
+				if (this != &other)
+				{
+					close();
+					handle = other.handle;
+					other.handle = Invalid_Socket;
+				}
+				return *this;
+			}
+			~Socket() { close(); }
+
+			socket_t get() const { return handle; }
+			bool isOpen() const { return handle != Invalid_Socket; }
+
+			void close()
+			{
+				if (handle == Invalid_Socket)
+					return;
+#ifdef _WIN32
+				closesocket(handle);
+#else
+				::close(handle);
+#endif
+				handle = Invalid_Socket;
+			}
+
+			bool setNonBlocking()
+			{
+#ifdef _WIN32
+				u_long on = 1;
+				return ioctlsocket(handle, FIONBIO, &on) == 0;
+#else
+				int flags = fcntl(handle, F_GETFL, 0);
+				return flags != -1 && fcntl(handle, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+			}
+
+			//Small frames go out at once instead of waiting for Nagle's algorithm to coalesce them
+			bool setNoDelay()
+			{
+				int on = 1;
+				return setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on)) == 0;
+			}
+
+			//Sends as much of data as the socket takes right now; sent says how much that was
+			IoStatus send(const char* data, size_t length, size_t& sent)
+			{
+				sent = 0;
+#ifdef _WIN32
+				int n = ::send(handle, data, int(length), 0);
+#elif defined(MSG_NOSIGNAL)
+				ssize_t n = ::send(handle, data, length, MSG_NOSIGNAL);	//A closed peer is an error, not SIGPIPE
+#else
+				ssize_t n = ::send(handle, data, length, 0);
+#endif
+				if (n >= 0)
+				{
+					sent = size_t(n);
+					return Io_Ok;
+				}
+				return wouldBlock() ? Io_WouldBlock : Io_Error;
+			}
+
+			IoStatus receive(char* buffer, size_t capacity, size_t& received)
+			{
+				received = 0;
+#ifdef _WIN32
+				int n = ::recv(handle, buffer, int(capacity), 0);
+#else
+				ssize_t n = ::recv(handle, buffer, capacity, 0);
+#endif
+				if (n > 0)
+				{
+					received = size_t(n);
+					return Io_Ok;
+				}
+				if (n == 0)
+					return Io_Closed;
+				return wouldBlock() ? Io_WouldBlock : Io_Error;
+			}
+
+			//Non-blocking TCP connect to an IPv4 address. The connection is established once the socket becomes
+			//writable; check connectResult() then.
+			static Socket connectTcp(const char* address, uint16_t port)
+			{
+				Socket s(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+				if (!s.isOpen() || !s.setNonBlocking())
+					return Socket();
+				s.setNoDelay();
+
+				Address addr;
+				if (!makeAddress(address, port, addr))
+					return Socket();
+				if (::connect(s.handle, (const sockaddr*)&addr, sizeof(addr)) != 0 && !wouldBlock())
+					return Socket();
+				return s;
+			}
+
+			//Non-blocking UDP socket bound to port on all interfaces (0: any free port)
+			static Socket bindUdp(uint16_t port)
+			{
+				Socket s(::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+				if (!s.isOpen() || !s.setNonBlocking())
+					return Socket();
+				sockaddr_in addr{};
+				addr.sin_family = AF_INET;
+				addr.sin_port = htons(port);
+				addr.sin_addr.s_addr = htonl(INADDR_ANY);
+				if (::bind(s.handle, (const sockaddr*)&addr, sizeof(addr)) != 0)
+					return Socket();
+				return s;
+			}
+
+			//Non-blocking UDP socket connected to one peer, so send() and receive() work on datagrams and
+			//datagrams from anyone else are filtered out by the system
+			static Socket connectUdp(const char* address, uint16_t port)
+			{
+				Socket s = bindUdp(0);
+				Address addr;
+				if (!s.isOpen() || !makeAddress(address, port, addr) || ::connect(s.handle, (const sockaddr*)&addr, sizeof(addr)) != 0)
+					return Socket();
+				return s;
+			}
+
+			IoStatus sendTo(const char* data, size_t length, const Address& to)
+			{
+#ifdef _WIN32
+				int n = ::sendto(handle, data, int(length), 0, (const sockaddr*)&to, sizeof(to));
+#else
+				ssize_t n = ::sendto(handle, data, length, 0, (const sockaddr*)&to, sizeof(to));
+#endif
+				if (n >= 0)
+					return Io_Ok;
+				return wouldBlock() ? Io_WouldBlock : Io_Error;
+			}
+
+			//Receives one datagram. Io_WouldBlock when there is none.
+			IoStatus receiveFrom(char* buffer, size_t capacity, size_t& received, Address& from)
+			{
+				received = 0;
+				socklen_t length = sizeof(from);
+#ifdef _WIN32
+				int n = ::recvfrom(handle, buffer, int(capacity), 0, (sockaddr*)&from, &length);
+#else
+				ssize_t n = ::recvfrom(handle, buffer, capacity, 0, (sockaddr*)&from, &length);
+#endif
+				if (n >= 0)
+				{
+					received = size_t(n);
+					return Io_Ok;
+				}
+				return wouldBlock() ? Io_WouldBlock : Io_Error;
+			}
+
+			//True when a connect started by connectTcp() succeeded
+			bool connectResult() const
+			{
+				int error = 0;
+				socklen_t length = sizeof(error);
+				if (getsockopt(handle, SOL_SOCKET, SO_ERROR, (char*)&error, &length) != 0)
+					return false;
+				return error == 0;
+			}
+
+			//Non-blocking listening TCP socket on all interfaces
+			static Socket listenTcp(uint16_t port, int backlog = SOMAXCONN)
+			{
+				Socket s(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+				if (!s.isOpen())
+					return Socket();
+				int on = 1;
+				setsockopt(s.handle, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+
+				sockaddr_in addr{};
+				addr.sin_family = AF_INET;
+				addr.sin_port = htons(port);
+				addr.sin_addr.s_addr = htonl(INADDR_ANY);
+				if (::bind(s.handle, (const sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(s.handle, backlog) != 0 ||
+					!s.setNonBlocking())
+					return Socket();
+				return s;
+			}
+
+			//Accepts one pending connection, already non-blocking. Returns a closed Socket when there is none.
+			Socket accept()
+			{
+				Socket client(::accept(handle, nullptr, nullptr));
+				if (client.isOpen())
+				{
+					client.setNonBlocking();
+					client.setNoDelay();
+				}
+				return client;
+			}
+		};
+
+		const uint32_t Event_Read = 0x1;
+		const uint32_t Event_Write = 0x2;
+		const uint32_t Event_Hangup = 0x4;	//Error or hangup; reported whether asked for or not
+
+		//Readiness notification for many sockets: epoll on Linux, poll/WSAPoll elsewhere. Every socket is
+		//registered with a caller-chosen 64 bit key that is handed back with its events.
+		class EventLoop
+		{
+#ifdef __linux__
+			int epoll_fd{ -1 };
+			std::vector<epoll_event> events{};
+
+			static uint32_t toEpoll(uint32_t interest)
+			{
+				return ((interest & Event_Read) ? uint32_t(EPOLLIN) : 0u) | ((interest & Event_Write) ? uint32_t(EPOLLOUT) : 0u);
+			}
+#else
+#ifdef _WIN32
+			typedef WSAPOLLFD pollfd_t;
+#else
+			typedef pollfd pollfd_t;
+#endif
+			std::vector<pollfd_t> fds{};
+			std::vector<uint64_t> keys{};
+			std::vector<std::pair<uint64_t, uint32_t>> ready{};	//Reused by every wait()
+
+			static short toPoll(uint32_t interest)
+			{
+				return short(((interest & Event_Read) ? POLLIN : 0) | ((interest & Event_Write) ? POLLOUT : 0));
+			}
+
+			size_t find(socket_t s) const
+			{
+				for (size_t i = 0; i < fds.size(); i++)
+					if (fds[i].fd == s)
+						return i;
+				return fds.size();
+			}
+#endif
+
+		public:
+			EventLoop(const EventLoop&) = delete;
+			EventLoop& operator=(const EventLoop&) = delete;
+
+#ifdef __linux__
+			EventLoop() : epoll_fd(epoll_create1(EPOLL_CLOEXEC)), events(256) {}
+			~EventLoop()
+			{
+				if (epoll_fd != -1)
+					::close(epoll_fd);
+			}
+
+			bool isOpen() const { return epoll_fd != -1; }
+
+			bool add(socket_t s, uint32_t interest, uint64_t key)
+			{
+				epoll_event e{};
+				e.events = toEpoll(interest);
+				e.data.u64 = key;
+				return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s, &e) == 0;
+			}
+
+			bool modify(socket_t s, uint32_t interest, uint64_t key)
+			{
+				epoll_event e{};
+				e.events = toEpoll(interest);
+				e.data.u64 = key;
+				return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, s, &e) == 0;
+			}
+
+			void remove(socket_t s)
+			{
+				epoll_event e{};
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s, &e);
+			}
+
+			//Waits up to timeout_ms (-1: forever) and calls on_event(key, events) for every ready socket.
+			//Returns the number of ready sockets, -1 on error.
+			template <typename F>
+			int wait(int timeout_ms, F&& on_event)
+			{
+				int n = epoll_wait(epoll_fd, events.data(), int(events.size()), timeout_ms);
+				if (n < 0)
+					return errno == EINTR ? 0 : -1;
+				for (int i = 0; i < n; i++)
+				{
+					uint32_t e = events[i].events;
+					uint32_t ready = ((e & EPOLLIN) ? Event_Read : 0) | ((e & EPOLLOUT) ? Event_Write : 0) |
+						((e & (EPOLLERR | EPOLLHUP)) ? Event_Hangup : 0);
+					on_event(events[i].data.u64, ready);
+				}
+				if (n == int(events.size()))
+					events.resize(events.size() * 2);
+				return n;
+			}
+#else
+			EventLoop() = default;
+
+			bool isOpen() const { return true; }
+
+			bool add(socket_t s, uint32_t interest, uint64_t key)
+			{
+				pollfd_t p{};
+				p.fd = s;
+				p.events = toPoll(interest);
+				fds.push_back(p);
+				keys.push_back(key);
+				return true;
+			}
+
+			bool modify(socket_t s, uint32_t interest, uint64_t key)
+			{
+				size_t i = find(s);
+				if (i == fds.size())
+					return false;
+				fds[i].events = toPoll(interest);
+				keys[i] = key;
+				return true;
+			}
+
+			void remove(socket_t s)
+			{
+				size_t i = find(s);
+				if (i == fds.size())
+					return;
+				fds[i] = fds.back();
+				fds.pop_back();
+				keys[i] = keys.back();
+				keys.pop_back();
+			}
+
+			template <typename F>
+			int wait(int timeout_ms, F&& on_event)
+			{
+#ifdef _WIN32
+				int n = fds.empty() ? (Sleep(DWORD(timeout_ms < 0 ? 0 : timeout_ms)), 0) : WSAPoll(fds.data(), ULONG(fds.size()), timeout_ms);
+#else
+				int n = poll(fds.data(), nfds_t(fds.size()), timeout_ms);
+				if (n < 0 && errno == EINTR)
+					return 0;
+#endif
+				if (n <= 0)
+					return n;
+				//on_event may add or remove sockets, so collect the ready ones first
+				ready.clear();
+				for (size_t i = 0; i < fds.size(); i++)
+				{
+					short r = fds[i].revents;
+					if (r == 0)
+						continue;
+					ready.push_back({ keys[i], uint32_t(((r & POLLIN) ? Event_Read : 0) | ((r & POLLOUT) ? Event_Write : 0) |
+						((r & (POLLERR | POLLHUP | POLLNVAL)) ? Event_Hangup : 0)) });
+				}
+				for (const auto& e : ready)
+					on_event(e.first, e.second);
+				return n;
+			}
+#endif
+		};
+	}
+}
+
+#endif // !SOCKET_H
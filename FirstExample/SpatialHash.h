@@ -0,0 +1,140 @@
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace sdds
+{
+	//Uniform grid broad phase for the (X, Y) plane.
+	//Every object is bucketed into all the cells its square collider overlaps. The grid is kept between ticks and
+	//an object is only re-bucketed when the range of cells it covers changes, so static obstacles cost nothing after
+	//their first insertion and slow bullets only move when they cross a cell border.
+	class SpatialHash
+	{
+		struct CellRange
+		{
+			int32_t min_x{};
+			int32_t min_y{};
+			int32_t max_x{};
+			int32_t max_y{};
+			bool inserted{};
+
+			bool operator==(const CellRange& other) const
+			{
+				return min_x == other.min_x && min_y == other.min_y && max_x == other.max_x && max_y == other.max_y;
+			}
+		};
+
+		float cell_size{};
+		float inv_cell_size{};
+		std::unordered_map<uint64_t, std::vector<uint32_t>> cells{};
+		std::vector<CellRange> ranges{};	//Indexed by object id
+
+		static uint64_t key(int32_t x, int32_t y)
+		{
+			return (uint64_t(uint32_t(x)) << 32) | uint32_t(y);
+		}
+
+		int32_t toCell(float v) const
+		{
+			return int32_t(std::floor(v * inv_cell_size));
+		}
+
+		void insertRange(uint32_t id, const CellRange& r)
+		{
+			for (int32_t cx = r.min_x; cx <= r.max_x; cx++)
+				for (int32_t cy = r.min_y; cy <= r.max_y; cy++)
+					cells[key(cx, cy)].push_back(id);
+		}
+
+		void eraseRange(uint32_t id, const CellRange& r)
+		{
+			for (int32_t cx = r.min_x; cx <= r.max_x; cx++)
+			{
+				for (int32_t cy = r.min_y; cy <= r.max_y; cy++)
+				{
+					//Buckets are small, so a linear search followed by swap-and-pop is the cheapest removal.
+					//Empty buckets are kept around so a bullet flying through a cell does not churn the map.
+					std::vector<uint32_t>& bucket = cells[key(cx, cy)];
+					for (size_t k = 0; k < bucket.size(); k++)
+					{
+						if (bucket[k] == id)
+						{
+							bucket[k] = bucket.back();
+							bucket.pop_back();
+							break;
+						}
+					}
+				}
+			}
+		}
+
+	public:
+		explicit SpatialHash(float cell = 2.0f) : cell_size(cell), inv_cell_size(1.0f / cell) {}
+
+		//Inserts the object or moves it to the cells covered by the square centered at (x, y) with the given half extent
+		void update(uint32_t id, float x, float y, float half_extent)
+		{
+			if (id >= ranges.size())
+				ranges.resize(id + 1);
+
+			CellRange r{ toCell(x - half_extent), toCell(y - half_extent), toCell(x + half_extent), toCell(y + half_extent), true };
+			CellRange& old = ranges[id];
+			if (old.inserted)
+			{
+				if (old == r)
+					return;	//Still covering the same cells, nothing to do
+				eraseRange(id, old);
+			}
+			insertRange(id, r);
+			old = r;
+		}
+
+		//Takes the object out of the grid (e.g. when it dies)
+		void remove(uint32_t id)
+		{
+			if (id >= ranges.size() || !ranges[id].inserted)
+				return;
+			eraseRange(id, ranges[id]);
+			ranges[id].inserted = false;
+		}
+
+		void clear()
+		{
+			cells.clear();
+			ranges.clear();
+		}
+
+		//Calls f(a, b) once for every pair of objects sharing at least one cell (a != b, each unordered pair only once)
+		template <typename F>
+		void forEachCandidatePair(F&& f) const
+		{
+			for (const auto& cell : cells)
+			{
+				const std::vector<uint32_t>& bucket = cell.second;
+				if (bucket.size() < 2)
+					continue;
+
+				int32_t cx = int32_t(uint32_t(cell.first >> 32));
+				int32_t cy = int32_t(uint32_t(cell.first));
+				for (size_t i = 0; i < bucket.size(); i++)
+				{
+					const CellRange& ri = ranges[bucket[i]];
+					for (size_t j = i + 1; j < bucket.size(); j++)
+					{
+						const CellRange& rj = ranges[bucket[j]];
+						//Two large objects may share several cells. Only report the pair from the lowest shared cell.
+						if (cx != std::max(ri.min_x, rj.min_x) || cy != std::max(ri.min_y, rj.min_y))
+							continue;
+						f(bucket[i], bucket[j]);
+					}
+				}
+			}
+		}
+	};
+}
+
+#endif // !SPATIAL_HASH_H
@@ -0,0 +1,96 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace sdds
+{
+	//Lock-free bounded FIFO for one producer thread and one consumer thread.
+	//The producer fills the slot at tail and then publishes the new tail; the consumer reads the slot at head and
+	//then publishes the new head. A slot is only ever touched by the thread that owns it at that moment, so the
+	//items themselves need no synchronization. Neither side waits: a full queue takes nothing, an empty one gives
+	//nothing. Each side caches the other side's index and only reloads it when it looks full (or empty), so the
+	//shared cache lines are rarely touched.
+	//
+	//Besides push() and pop(), items can be written and read in place (claim()/publish(), front()/release()).
+	//The slots then keep whatever memory their members own, e.g. a string's capacity, and passing items through
+	//the queue allocates nothing once the slots have grown to fit.
+	template <typename T, size_t Capacity>
+	class SpscQueue
+	{
+		static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+		enum : size_t { Cache_Line = 64, Index_Mask = Capacity - 1 };
+
+		T slots[Capacity]{};
+		alignas(Cache_Line) std::atomic<size_t> head{};	//Next slot to pop, written by the consumer
+		size_t cached_tail{};							//Consumer's copy of tail
+		alignas(Cache_Line) std::atomic<size_t> tail{};	//Next slot to push, written by the producer
+		size_t cached_head{};							//Producer's copy of head
+
+	public:
+		//Producer side. The slot to fill next, or nullptr when the queue is full. It holds whatever was last in it.
+		T* claim()
+		{
+			size_t at = tail.load(std::memory_order_relaxed);
+			if (at - cached_head == Capacity)
+			{
+				cached_head = head.load(std::memory_order_acquire);
+				if (at - cached_head == Capacity)
+					return nullptr;
+			}
+			return &slots[at & Index_Mask];
+		}
+
+		//Hands the slot from claim() over to the consumer
+		void publish()
+		{
+			tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		//Moves item in and returns true, or leaves it alone and returns false when the queue is full
+		bool push(T&& item)
+		{
+			T* slot = claim();
+			if (!slot)
+				return false;
+			*slot = std::move(item);
+			publish();
+			return true;
+		}
+
+		//Consumer side. The oldest item, or nullptr when the queue is empty.
+		T* front()
+		{
+			size_t at = head.load(std::memory_order_relaxed);
+			if (at == cached_tail)
+			{
+				cached_tail = tail.load(std::memory_order_acquire);
+				if (at == cached_tail)
+					return nullptr;
+			}
+			return &slots[at & Index_Mask];
+		}
+
+		//Gives the slot from front() back to the producer
+		void release()
+		{
+			head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		//Moves the oldest item out into item and returns true, or returns false when the queue is empty
+		bool pop(T& item)
+		{
+			T* slot = front();
+			if (!slot)
+				return false;
+			item = std::move(*slot);
+			release();
+			return true;
+		}
+
+		static constexpr size_t capacity() { return Capacity; }
+	};
+}
+
+#endif // !SPSC_QUEUE_H
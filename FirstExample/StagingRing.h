@@ -0,0 +1,88 @@
+#ifndef STAGING_RING_H
+#define STAGING_RING_H
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+namespace sdds
+{
+	//Hands out byte ranges of a fixed-size ring, e.g. a mapped pixel buffer, and takes them back once the GPU has
+	//read them. Positions are counted in bytes since the ring was created, so the ranges tile that count in the order
+	//they were reserved; a range that would run past the end of the ring starts over at offset 0 and the skipped tail
+	//belongs to it. Ranges may be released in any order: the free space only grows once every older range is back.
+	//reserve() may be called from any thread.
+	class StagingRing
+	{
+	public:
+		enum : size_t { Alignment = 16 };
+
+		struct Range
+		{
+			uint64_t begin{};	//Position in the byte count, including the skipped tail if the range wrapped
+			uint64_t end{};
+			size_t offset{};	//Where the data goes in the ring
+		};
+
+	private:
+		size_t size;
+		mutable std::mutex lock{};
+		uint64_t reserved{};	//Bytes handed out so far
+		uint64_t retired{};		//Bytes given back, counting only the ones before the oldest range still out
+		std::map<uint64_t, uint64_t> released{};	//begin -> end of the ranges given back out of order
+
+	public:
+		explicit StagingRing(size_t bytes) : size(bytes / Alignment * Alignment) {}
+
+		StagingRing(const StagingRing&) = delete;
+		StagingRing& operator=(const StagingRing&) = delete;
+
+		//Returns false when the ring has no room for bytes right now; it never waits.
+		bool reserve(size_t bytes, Range& range)
+		{
+			if (bytes > size || size == 0)
+				return false;
+			size_t length = (bytes + Alignment - 1) / Alignment * Alignment;
+			std::lock_guard<std::mutex> guard(lock);
+			size_t position = size_t(reserved % size);
+			size_t skip = position + length > size ? size - position : 0;
+			if (reserved - retired + skip + length > size)
+				return false;
+			range.begin = reserved;
+			range.offset = skip ? 0 : position;
+			reserved += skip + length;
+			range.end = reserved;
+			return true;
+		}
+
+		void release(const Range& range)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			released[range.begin] = range.end;
+			for (auto oldest = released.begin(); oldest != released.end() && oldest->first == retired; oldest = released.begin())
+			{
+				retired = oldest->second;
+				released.erase(oldest);
+			}
+		}
+
+		//Takes back every range at once, e.g. after the buffer behind the ring was orphaned. Nobody may still be
+		//writing to a range reserved before the call, and those ranges are not released again.
+		void reset()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			retired = reserved;
+			released.clear();
+		}
+
+		size_t capacity() const { return size; }
+
+		size_t inUse() const
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			return size_t(reserved - retired);
+		}
+	};
+}
+
+#endif // !STAGING_RING_H
@@ -0,0 +1,264 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "StagingRing.h"
+
+namespace sdds
+{
+	//Decodes image files on a pool of worker threads and hands the pixels over to the thread that owns the GL context.
+	//Every load() gets a ticket, its position among the load() calls. The GL thread takes the decoded images in the
+	//order they finish, uploads them through a callback and gives the pixels back; the loader keeps the decode and
+	//upload time of every asset. The decoder is passed in (SOIL_load_image and SOIL_free_image_data in the game), so
+	//this header needs neither SOIL nor GL.
+	//An optional stage runs on the worker right after the decode, e.g. to copy the pixels into a mapped pixel buffer.
+	class TextureLoader
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+		typedef unsigned char* (*Decoder)(const char* path, int* width, int* height, int* channels, int force_channels);
+		typedef void (*Releaser)(unsigned char* pixels);
+
+		//A decoded image on its way to the GL thread. pixels is nullptr when the file could not be decoded, or when
+		//the stage moved them out of client memory (staged is then set).
+		struct Image
+		{
+			size_t ticket{};
+			std::string path{};
+			unsigned char* pixels{};
+			int width{};
+			int height{};
+			int channels{};		//Channels in the file, before force_channels
+			size_t bytes{};		//Size of the pixel data, after force_channels
+			bool staged{};
+			StagingRing::Range staging{};	//Where the stage put the pixels
+			double decode_ms{};
+		};
+
+		//Called on a worker with every decoded image. To take the pixels it copies them, fills in staging and sets
+		//staged; the loader then frees the client copy.
+		typedef std::function<void(Image&)> Stage;
+
+		struct Timing
+		{
+			std::string path{};
+			double decode_ms{};
+			double upload_ms{};
+			bool loaded{};
+		};
+
+	private:
+		struct Job
+		{
+			size_t ticket{};
+			std::string path{};
+			int force_channels{};
+		};
+
+		Decoder decode;
+		Releaser release;
+		Stage stage;
+		std::vector<std::thread> workers{};
+
+		std::mutex lock{};
+		std::condition_variable job_ready{};	//Workers wait here for jobs
+		std::condition_variable image_ready{};	//The GL thread waits here for decoded images
+		std::deque<Job> jobs{};
+		std::deque<Image> images{};
+		bool stopping{};
+
+		//Owned by the GL thread
+		std::vector<Timing> timing{};
+		size_t delivered{};
+		clock::time_point first_load{};
+		clock::time_point last_upload{};
+
+		void work()
+		{
+			for (;;)
+			{
+				Job job;
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					job_ready.wait(guard, [this] { return stopping || !jobs.empty(); });
+					if (stopping)
+						return;
+					job = std::move(jobs.front());
+					jobs.pop_front();
+				}
+
+				Image image;
+				image.ticket = job.ticket;
+				image.path = std::move(job.path);
+				clock::time_point start = clock::now();
+				image.pixels = decode(image.path.c_str(), &image.width, &image.height, &image.channels, job.force_channels);
+				image.decode_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+				if (!image.pixels)
+					image.width = image.height = image.channels = 0;
+				image.bytes = size_t(image.width) * image.height * (job.force_channels ? job.force_channels : image.channels);
+				if (image.pixels && stage)
+				{
+					stage(image);
+					if (image.staged)
+					{
+						release(image.pixels);
+						image.pixels = nullptr;
+					}
+				}
+
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					images.push_back(std::move(image));
+				}
+				image_ready.notify_one();
+			}
+		}
+
+		template <typename Upload>
+		void deliver(Image& image, Upload& upload)
+		{
+			clock::time_point start = clock::now();
+			upload(static_cast<const Image&>(image));
+			last_upload = clock::now();
+
+			Timing& t = timing[image.ticket];
+			t.decode_ms = image.decode_ms;
+			t.upload_ms = std::chrono::duration<double, std::milli>(last_upload - start).count();
+			t.loaded = image.pixels != nullptr || image.staged;
+			if (image.pixels)
+				release(image.pixels);
+			image.pixels = nullptr;
+			delivered++;
+		}
+
+	public:
+		//worker_count == 0 uses one worker per hardware thread
+		TextureLoader(Decoder decoder, Releaser releaser, unsigned worker_count = 0, Stage stager = nullptr)
+			: decode(decoder), release(releaser), stage(std::move(stager))
+		{
+			if (worker_count == 0)
+				worker_count = std::thread::hardware_concurrency();
+			if (worker_count == 0)
+				worker_count = 1;
+			for (unsigned i = 0; i < worker_count; i++)
+				workers.emplace_back(&TextureLoader::work, this);
+		}
+
+		TextureLoader(const TextureLoader&) = delete;
+		TextureLoader& operator=(const TextureLoader&) = delete;
+
+		//Drops the jobs nobody started, waits for the running ones and frees every image that was not uploaded
+		~TextureLoader()
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				stopping = true;
+				jobs.clear();
+			}
+			job_ready.notify_all();
+			for (std::thread& worker : workers)
+				worker.join();
+			for (Image& image : images)
+				if (image.pixels)
+					release(image.pixels);
+		}
+
+		//GL thread. Queues a file for decoding and returns its ticket.
+		size_t load(const std::string& path, int force_channels)
+		{
+			size_t ticket = timing.size();
+			if (ticket == delivered)
+				first_load = clock::now();
+			timing.push_back(Timing{ path });
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				jobs.push_back(Job{ ticket, path, force_channels });
+			}
+			job_ready.notify_one();
+			return ticket;
+		}
+
+		//GL thread. Number of loads whose images have not been uploaded yet.
+		size_t pending() const { return timing.size() - delivered; }
+
+		//GL thread. Uploads the images decoded so far without waiting for the others; upload is called with a
+		//const Image&. Stops before the image that would take the frame past max_bytes, but always uploads at least
+		//one. Returns how many were uploaded.
+		template <typename Upload>
+		size_t uploadReady(Upload upload, size_t max_bytes = SIZE_MAX)
+		{
+			size_t count = 0, bytes = 0;
+			for (;;)
+			{
+				Image image;
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					if (images.empty() || (count > 0 && images.front().bytes > max_bytes - bytes))
+						break;
+					image = std::move(images.front());
+					images.pop_front();
+				}
+				bytes += image.bytes < max_bytes - bytes ? image.bytes : max_bytes - bytes;
+				deliver(image, upload);
+				count++;
+			}
+			return count;
+		}
+
+		//GL thread. Uploads every pending image, each one as soon as it is decoded.
+		template <typename Upload>
+		void uploadAll(Upload upload)
+		{
+			while (pending() > 0)
+			{
+				Image image;
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					image_ready.wait(guard, [this] { return !images.empty(); });
+					image = std::move(images.front());
+					images.pop_front();
+				}
+				deliver(image, upload);
+			}
+		}
+
+		//Per ticket
+		const std::vector<Timing>& timings() const { return timing; }
+
+		size_t workerCount() const { return workers.size(); }
+
+		//One line per asset, then the totals. Wall time runs from the first load() after the loader was idle to the
+		//last upload.
+		void report(std::ostream& out) const
+		{
+			std::ios_base::fmtflags flags = out.flags();
+			std::streamsize precision = out.precision();
+			double decode_total = 0, upload_total = 0;
+			for (const Timing& t : timing)
+			{
+				out << std::setw(24) << std::left << t.path << std::right << std::fixed << std::setprecision(2)
+					<< " decode " << std::setw(8) << t.decode_ms << " ms, upload " << std::setw(7) << t.upload_ms << " ms"
+					<< (t.loaded ? "" : ", FAILED") << std::endl;
+				decode_total += t.decode_ms;
+				upload_total += t.upload_ms;
+			}
+			double wall = std::chrono::duration<double, std::milli>(last_upload - first_load).count();
+			out << timing.size() << " textures on " << workers.size() << " workers: decode " << decode_total
+				<< " ms, upload " << upload_total << " ms, wall " << wall << " ms" << std::endl;
+			out.flags(flags);
+			out.precision(precision);
+		}
+	};
+}
+
+#endif // !TEXTURE_LOADER_H
@@ -0,0 +1,232 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include "vgl.h"
+#include "StagingRing.h"
+#include "TextureLoader.h"
+
+namespace sdds
+{
+	//Streams image files into existing textures without stalling the frame. The files are decoded by a TextureLoader;
+	//the pixels travel through a ring of one pixel unpack buffer and reach their texture through glTexSubImage2D
+	//from an offset in that buffer, so the copy into the texture runs on the GPU. A fence after every frame's uploads
+	//tells when their part of the ring can be written again.
+	//With GL 4.4 or ARB_buffer_storage the ring is mapped once, persistently, and the workers copy the decoded pixels
+	//into it themselves. Without it the GL thread copies them through an unsynchronized mapping, and orphans the
+	//buffer instead of waiting when the ring is full.
+	//Everything but the decoding runs on the thread that owns the GL context. The destructor does not call GL: the
+	//buffer and the fences go with the context.
+	class TextureStreamer
+	{
+	public:
+		enum : size_t
+		{
+			Default_Ring_Bytes = 32 << 20,
+			Default_Frame_Budget = 8 << 20	//Bytes uploaded per pump()
+		};
+
+	private:
+		//Fence after one pump()'s uploads and the ring ranges they read
+		struct InFlight
+		{
+			GLsync fence{};
+			std::vector<StagingRing::Range> ranges{};
+		};
+
+		StagingRing ring;
+		GLuint buffer{};
+		unsigned char* mapped{};	//Persistent mapping, nullptr when the ring is filled through glMapBufferRange
+		std::vector<GLuint> targets{};	//Texture of every ticket
+		std::vector<StagingRing::Range> batch{};	//Ranges read by the uploads of the current pump()
+		std::deque<InFlight> in_flight{};
+		size_t direct_uploads{};
+		TextureLoader loader;	//Last, so the workers are gone before the ring
+
+		static GLenum formatOf(const TextureLoader::Image& image)
+		{
+			switch (image.bytes / (size_t(image.width) * image.height))
+			{
+			case 1: return GL_RED;
+			case 2: return GL_RG;
+			case 4: return GL_RGBA;
+			default: return GL_RGB;
+			}
+		}
+
+		//Worker thread, persistent mapping only. Leaves the image alone when the ring is full; the GL thread tries
+		//again when it uploads it.
+		void stageOnWorker(TextureLoader::Image& image)
+		{
+			if (!mapped || !ring.reserve(image.bytes, image.staging))
+				return;
+			std::memcpy(mapped + image.staging.offset, image.pixels, image.bytes);
+			image.staged = true;
+		}
+
+		//GL thread. Copies pixels that are still in client memory into the ring.
+		bool stage(const TextureLoader::Image& image, StagingRing::Range& range)
+		{
+			if (!ring.reserve(image.bytes, range))
+			{
+				if (mapped || image.bytes > ring.capacity())
+					return false;
+				orphan();
+				if (!ring.reserve(image.bytes, range))
+					return false;
+			}
+			if (mapped)
+			{
+				std::memcpy(mapped + range.offset, image.pixels, image.bytes);
+				return true;
+			}
+			//The fences keep the GPU off this range, so the mapping does not have to wait for it
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+			void* to = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, range.offset, image.bytes,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			if (to)
+			{
+				std::memcpy(to, image.pixels, image.bytes);
+				if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+					return true;
+			}
+			ring.release(range);
+			return false;
+		}
+
+		//GL thread. Gives the buffer fresh storage; the driver keeps the old one until the uploads reading it are done.
+		void orphan()
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, ring.capacity(), nullptr, GL_STREAM_DRAW);
+			for (InFlight& frame : in_flight)
+				glDeleteSync(frame.fence);
+			in_flight.clear();
+			batch.clear();
+			ring.reset();
+		}
+
+		void upload(const TextureLoader::Image& image)
+		{
+			if (!image.pixels && !image.staged)
+				return;	//Not decoded, the texture keeps what it had
+
+			GLenum format = formatOf(image);
+			glBindTexture(GL_TEXTURE_2D, targets[image.ticket]);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+
+			StagingRing::Range range = image.staging;
+			if (!image.staged && !stage(image, range))
+			{
+				//Larger than the ring, or the persistent ring is still being read by the GPU
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, format, GL_UNSIGNED_BYTE, image.pixels);
+				direct_uploads++;
+				return;
+			}
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, format, GL_UNSIGNED_BYTE, BUFFER_OFFSET(range.offset));
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			batch.push_back(range);
+		}
+
+		//GL thread. Gives back the ring ranges of the uploads the GPU has finished. Waits only when a fence cannot be
+		//waited on (GL_WAIT_FAILED): then glFinish() makes sure the GPU is done with the ranges before they are reused.
+		void retire()
+		{
+			while (!in_flight.empty())
+			{
+				GLenum state = glClientWaitSync(in_flight.front().fence, 0, 0);
+				if (state == GL_TIMEOUT_EXPIRED)
+					break;
+				if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+					glFinish();
+				glDeleteSync(in_flight.front().fence);
+				for (const StagingRing::Range& range : in_flight.front().ranges)
+					ring.release(range);
+				in_flight.pop_front();
+			}
+		}
+
+		static bool persistentMappingAvailable()
+		{
+			return (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) && glBufferStorage != nullptr;
+		}
+
+	public:
+		//GL thread, after glewInit(). worker_count == 0 uses one worker per hardware thread.
+		TextureStreamer(TextureLoader::Decoder decoder, TextureLoader::Releaser releaser,
+			size_t ring_bytes = Default_Ring_Bytes, unsigned worker_count = 0)
+			: ring(ring_bytes),
+			  loader(decoder, releaser, worker_count, [this](TextureLoader::Image& image) { stageOnWorker(image); })
+		{
+			//The workers only read mapped once a load() hands them a job
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+			if (persistentMappingAvailable())
+			{
+				GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+				glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ring.capacity(), nullptr, flags);
+				mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ring.capacity(), flags));
+				if (!mapped)
+				{
+					//Immutable storage cannot be respecified, start over with a plain buffer
+					glDeleteBuffers(1, &buffer);
+					glGenBuffers(1, &buffer);
+					glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+				}
+			}
+			if (!mapped)
+				glBufferData(GL_PIXEL_UNPACK_BUFFER, ring.capacity(), nullptr, GL_STREAM_DRAW);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+
+		TextureStreamer(const TextureStreamer&) = delete;
+		TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+		//GL thread. Queues a file for texture, which keeps its current image until the file arrives. Returns the
+		//ticket of the load.
+		size_t stream(const std::string& path, GLuint texture, int force_channels)
+		{
+			targets.push_back(texture);
+			return loader.load(path, force_channels);
+		}
+
+		//GL thread, once a frame. Uploads the images decoded since the last call, up to byte_budget bytes (at least
+		//one image), and retires the uploads the GPU is done with.
+		void pump(size_t byte_budget = Default_Frame_Budget)
+		{
+			retire();
+			if (loader.pending() == 0)
+				return;
+
+			GLint alignment;
+			glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);	//Rows are tightly packed, RGB rows are not 4-byte multiples
+			loader.uploadReady([this](const TextureLoader::Image& image) { upload(image); }, byte_budget);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+			if (!batch.empty())
+			{
+				in_flight.push_back(InFlight{ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), std::move(batch) });
+				batch.clear();
+			}
+		}
+
+		//Loads whose images have not reached their texture yet
+		size_t pending() const { return loader.pending(); }
+
+		bool persistent() const { return mapped != nullptr; }
+
+		//Uploads that bypassed the ring because it had no room
+		size_t directUploads() const { return direct_uploads; }
+
+		const TextureLoader& textureLoader() const { return loader; }
+	};
+}
+
+#endif // !TEXTURE_STREAMER_H
@@ -0,0 +1,50 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+#include <atomic>
+#include <cstdint>
+
+namespace sdds
+{
+	//Lock-free triple buffer for one writer thread and one reader thread.
+	//The writer fills writeBuffer() and publish()es it; the reader calls acquire() and then reads readBuffer(), which
+	//is always the most recently published buffer. The two threads never touch the same buffer, neither of them ever
+	//waits, and the reader simply skips any buffer that was replaced before it got to read it.
+	template <typename T>
+	class TripleBuffer
+	{
+		enum : uint8_t { Index_Mask = 0x3, Fresh = 0x4 };
+
+		T buffers[3]{};
+		std::atomic<uint8_t> middle{ 1 };	//Index of the buffer in between, plus Fresh when it has not been read yet
+		uint8_t back{ 0 };					//Owned by the writer
+		uint8_t front{ 2 };					//Owned by the reader
+
+	public:
+		//Writer side
+		T& writeBuffer()
+		{
+			return buffers[back];
+		}
+
+		void publish()
+		{
+			back = middle.exchange(uint8_t(back | Fresh), std::memory_order_acq_rel) & Index_Mask;
+		}
+
+		//Reader side. Returns true when a newer buffer than the previous readBuffer() was taken.
+		bool acquire()
+		{
+			if ((middle.load(std::memory_order_relaxed) & Fresh) == 0)
+				return false;
+			front = middle.exchange(front, std::memory_order_acq_rel) & Index_Mask;
+			return true;
+		}
+
+		const T& readBuffer() const
+		{
+			return buffers[front];
+		}
+	};
+}
+
+#endif // !TRIPLE_BUFFER_H
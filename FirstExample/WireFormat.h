@@ -0,0 +1,200 @@
+#ifndef WIRE_FORMAT_H
+#define WIRE_FORMAT_H
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace sdds
+{
+	//Building blocks of the network protocol. Everything on the wire is little-endian and independent of the host's
+	//struct layout. Every message is a frame:
+	//
+	//    u16 payload length | u8 protocol version | u8 message type | payload
+	//
+	//The length covers the payload only, so a reader can tell from the first Frame_Header_Size bytes how much more
+	//it needs. Decoders work directly on the receive buffer and never copy or allocate; they return false when the
+	//input is truncated or malformed.
+	namespace wire
+	{
+		enum : uint8_t { Protocol_Version = 1 };
+
+		enum MessageType : uint8_t
+		{
+			Msg_Player = 1,		//One player record
+			//2 was Msg_Snapshot, every player record in one message; see Msg_Delta and Msg_Positions in DeltaCodec.h
+		};
+
+		enum : size_t
+		{
+			Frame_Header_Size = 4,
+			Max_Payload_Size = 0xFFFF,
+			Max_Varint_Size = 5,	//For 32 bit values
+			Max_Name_Length = 255,	//Bytes. Longer names are cut by the sender and rejected by the receiver.
+		};
+
+		//Locations are sent as fixed-point integers with 1/64 unit resolution (about 1.5 cm)
+		const float Location_Quantum = 1.0f / 64.0f;
+
+		struct FrameHeader
+		{
+			uint16_t length{};
+			uint8_t version{};
+			uint8_t type{};
+		};
+
+		inline void putU16(char* out, uint16_t v)
+		{
+			out[0] = char(v & 0xFF);
+			out[1] = char(v >> 8);
+		}
+
+		inline uint16_t getU16(const char* in)
+		{
+			return uint16_t(uint8_t(in[0]) | (uint8_t(in[1]) << 8));
+		}
+
+		inline void putU32(char* out, uint32_t v)
+		{
+			for (int i = 0; i < 4; i++)
+				out[i] = char((v >> (8 * i)) & 0xFF);
+		}
+
+		inline uint32_t getU32(const char* in)
+		{
+			uint32_t v = 0;
+			for (int i = 0; i < 4; i++)
+				v |= uint32_t(uint8_t(in[i])) << (8 * i);
+			return v;
+		}
+
+		//LEB128: 7 bits per byte, low bits first, high bit set on every byte but the last. Returns the bytes written.
+		inline size_t putVarint(char* out, uint32_t v)
+		{
+			size_t n = 0;
+			while (v >= 0x80)
+			{
+				out[n++] = char((v & 0x7F) | 0x80);
+				v >>= 7;
+			}
+			out[n++] = char(v);
+			return n;
+		}
+
+		inline bool getVarint(const char*& cursor, const char* end, uint32_t& v)
+		{
+			v = 0;
+			for (size_t i = 0; i < Max_Varint_Size; i++)
+			{
+				if (cursor >= end)
+					return false;
+				uint8_t byte = uint8_t(*cursor++);
+				v |= uint32_t(byte & 0x7F) << (7 * i);
+				if ((byte & 0x80) == 0)
+					return true;
+			}
+			return false;	//More than 5 bytes: not a 32 bit varint
+		}
+
+		//Zigzag mapping so small negative numbers also get short varints: 0, -1, 1, -2... -> 0, 1, 2, 3...
+		inline uint32_t zigzag(int32_t v)
+		{
+			return (uint32_t(v) << 1) ^ uint32_t(v >> 31);
+		}
+
+		inline int32_t unzigzag(uint32_t v)
+		{
+			return int32_t(v >> 1) ^ -int32_t(v & 1);
+		}
+
+		inline int32_t quantize(float v)
+		{
+			float q = std::floor(v / Location_Quantum + 0.5f);
+			if (!(q > -2147483000.0f))	//Also catches NaN
+				q = -2147483000.0f;
+			if (q > 2147483000.0f)
+				q = 2147483000.0f;
+			return int32_t(q);
+		}
+
+		inline float dequantize(int32_t q)
+		{
+			return float(q) * Location_Quantum;
+		}
+
+		inline void putFrameHeader(char* out, uint16_t payload_length, uint8_t type)
+		{
+			putU16(out, payload_length);
+			out[2] = char(Protocol_Version);
+			out[3] = char(type);
+		}
+
+		//Reads a frame header. Returns false when fewer than Frame_Header_Size bytes are available.
+		inline bool getFrameHeader(const char* in, size_t available, FrameHeader& header)
+		{
+			if (available < Frame_Header_Size)
+				return false;
+			header.length = getU16(in);
+			header.version = uint8_t(in[2]);
+			header.type = uint8_t(in[3]);
+			return true;
+		}
+
+		//Reassembles frames from a byte stream. Bytes are received straight into the reader's buffer (see space()
+		//and commit()); next() then hands out complete frames in place, without copying them. The buffer starts
+		//small and grows to the largest frame seen, so in steady state receiving allocates nothing.
+		class FrameReader
+		{
+			enum : size_t { Min_Receive = 1024 };
+
+			std::vector<char> buffer{};
+			size_t begin{};	//First byte not handed out yet
+			size_t end{};	//One past the last received byte
+
+		public:
+			explicit FrameReader(size_t capacity = 4096) : buffer(capacity < Min_Receive ? size_t(Min_Receive) : capacity) {}
+
+			//Free space at the end of the buffer to receive into: at least Min_Receive bytes, and enough for the
+			//whole frame whose header has arrived. Moves unread bytes to the front first.
+			char* space(size_t& available)
+			{
+				if (begin > 0)
+				{
+					memmove(buffer.data(), buffer.data() + begin, end - begin);
+					end -= begin;
+					begin = 0;
+				}
+				size_t needed = end + Min_Receive;
+				FrameHeader header;
+				if (getFrameHeader(buffer.data(), end, header) && Frame_Header_Size + header.length > needed)
+					needed = Frame_Header_Size + header.length;
+				if (buffer.size() < needed)
+					buffer.resize(needed > 2 * buffer.size() ? needed : 2 * buffer.size());
+				available = buffer.size() - end;
+				return buffer.data() + end;
+			}
+
+			void commit(size_t received)
+			{
+				end += received;
+			}
+
+			//Takes the next complete frame. The payload stays valid until the next call to space().
+			bool next(FrameHeader& header, const char*& payload)
+			{
+				if (!getFrameHeader(buffer.data() + begin, end - begin, header))
+					return false;
+				if (end - begin < Frame_Header_Size + header.length)
+					return false;
+				payload = buffer.data() + begin + Frame_Header_Size;
+				begin += Frame_Header_Size + header.length;
+				if (begin == end)
+					begin = end = 0;
+				return true;
+			}
+		};
+	}
+}
+
+#endif // !WIRE_FORMAT_H
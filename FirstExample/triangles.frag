@@ -3,9 +3,9 @@
 in vec2 texCoord;
 out vec4 fColor;
 
-uniform sampler2D texture;
+uniform sampler2D tex;
 
 void main()
 {
-	fColor = texture2D(texture, texCoord);
-}
\ No newline at end of file
+	fColor = texture(tex, texCoord);
+}
@@ -1,6 +1,8 @@
 #version 430 core
 layout(location = 0) in vec4 vPosition;
 layout(location = 1) in vec2 vTexCoord;
+layout(location = 2) in vec3 vInstanceOffset;	//Per instance. (0, 0, 0) when not drawing instanced
+layout(location = 3) in vec3 vInstanceScale;	//Per instance. (1, 1, 1) when not drawing instanced
 
 uniform mat4 model_matrix;
 uniform mat4 camera_matrix;
@@ -10,6 +12,7 @@ out vec2 texCoord;
 
 void main()
 {
-	gl_Position = projection_matrix * camera_matrix * model_matrix * vPosition;
+	vec4 position = vec4(vPosition.xyz * vInstanceScale + vInstanceOffset, 1.0);
+	gl_Position = projection_matrix * camera_matrix * model_matrix * position;
 	texCoord = vTexCoord;
 }
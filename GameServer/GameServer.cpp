@@ -0,0 +1,448 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Headless, authoritative server for the 3D_World_Traversal client.
+// Accepts clients on TCP port 27000, keeps the table of all players and broadcasts it to every client at a fixed
+// tick rate, delta-compressed per client (see FirstExample/DeltaCodec.h). Joins, leaves and names go over TCP;
+// locations go over UDP on the same port once a client has sent one (see FirstExample/Session.h).
+//
+//    GameServer [--port 27000] [--tick-rate 60] [--redundancy 0] [--seconds 0]
+//
+// --tick-rate is in Hz and is clamped to 20..128. --redundancy N repeats each client's previous N snapshots in
+// every datagram, so a lost datagram costs nothing as long as one of the next N arrives. --seconds 0 runs until
+// killed.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "../FirstExample/Connection.h"
+#include "../FirstExample/DeltaCodec.h"
+#include "../FirstExample/Player.h"
+#include "../FirstExample/PlayerSerializer.h"
+#include "../FirstExample/Session.h"
+#include "../FirstExample/Socket.h"
+#include "../FirstExample/WireFormat.h"
+
+using namespace sdds;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Client
+{
+	Connection connection{};
+	std::string name{};
+	Location location{};
+	bool joined{};			//Sent its first Msg_Player, so it has a name and is part of the snapshots
+	bool watching_write{};
+	uint32_t acked{};		//Newest snapshot the client decoded
+	uint32_t token{};		//From the welcome, proves that a datagram comes from this client
+	bool has_udp{};			//A valid Msg_Location arrived, so udp_address is known
+	net::Address udp_address{};
+	uint32_t location_sequence{};
+	std::vector<char> recent{};			//The last snapshot frames sent over UDP, oldest first, for redundancy
+	std::vector<size_t> recent_sizes{};
+};
+
+class GameServer
+{
+	enum : uint64_t { Listener_Key = 0, Udp_Key = ~uint64_t(0) };
+	enum : size_t { Max_Backlog = 1 << 20 };	//A client that falls this far behind is dropped
+
+	net::Socket listener{};
+	net::Socket udp{};
+	std::vector<char> datagram{};
+	std::mt19937 random{ std::random_device{}() };
+	net::EventLoop loop{};
+	std::map<uint32_t, Client> clients{};	//By player id, so iterating yields the players sorted by id
+	uint32_t next_id{ 1 };
+	std::vector<uint32_t> dropped{};
+
+	//The world as broadcast on the last Delta_Ring_Size ticks. Clients are encoded against one of these.
+	DeltaSnapshot history[Delta_Ring_Size]{};
+	uint32_t sequence{};
+
+	//Frames encoded this tick, one per distinct baseline. Most clients acknowledged one of the last two or three
+	//ticks, so a handful of encodes serves all of them.
+	struct Encoded
+	{
+		uint32_t base{};
+		size_t offset{};
+		size_t length{};
+	};
+	std::vector<Encoded> encoded{};
+	std::vector<char> encoded_bytes{};
+	std::vector<char> scratch{};
+
+	double tick_ms{};
+	int redundancy{};
+
+public:
+	//Statistics, reset by the caller
+	struct Stats
+	{
+		unsigned long ticks{};
+		unsigned long overruns{};	//Ticks that started more than a tick late
+		unsigned long encodes{};
+		double busy_ms{};
+		double max_tick_ms{};
+		unsigned long long bytes_out{};
+		unsigned long long udp_bytes_out{};
+		unsigned long stale_locations{};	//Msg_Location datagrams dropped as older than one already applied
+		unsigned long accepted{};
+		unsigned long disconnected{};
+	} stats{};
+
+	GameServer(double tick_rate, int redundant_snapshots) : tick_ms(1000.0 / tick_rate), redundancy(redundant_snapshots) {}
+
+	bool start(uint16_t port)
+	{
+		listener = net::Socket::listenTcp(port);
+		udp = net::Socket::bindUdp(port);
+		if (!listener.isOpen() || !udp.isOpen() || !loop.isOpen())
+			return false;
+		datagram.resize(65536);
+		return loop.add(listener.get(), net::Event_Read, Listener_Key) && loop.add(udp.get(), net::Event_Read, Udp_Key);
+	}
+
+	size_t clientCount() const { return clients.size(); }
+
+	//Serves clients until deadline
+	void run(Clock::time_point deadline)
+	{
+		Clock::time_point next_tick = Clock::now();
+		while (Clock::now() < deadline)
+		{
+			int timeout = int(std::chrono::duration_cast<std::chrono::milliseconds>(next_tick - Clock::now()).count());
+			loop.wait(std::max(0, timeout), [this](uint64_t key, uint32_t events) { onEvent(key, events); });
+			dropClients();
+
+			Clock::time_point now = Clock::now();
+			if (now < next_tick)
+				continue;
+			if (now - next_tick > std::chrono::duration<double, std::milli>(tick_ms))
+			{
+				stats.overruns++;
+				next_tick = now;
+			}
+			next_tick += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(tick_ms));
+
+			broadcast();
+			dropClients();
+			double busy = std::chrono::duration<double, std::milli>(Clock::now() - now).count();
+			stats.busy_ms += busy;
+			stats.max_tick_ms = std::max(stats.max_tick_ms, busy);
+			stats.ticks++;
+		}
+	}
+
+private:
+	void onEvent(uint64_t key, uint32_t events)
+	{
+		if (key == Listener_Key)
+		{
+			accept();
+			return;
+		}
+		if (key == Udp_Key)
+		{
+			receiveDatagrams();
+			return;
+		}
+
+		auto found = clients.find(uint32_t(key));
+		if (found == clients.end())
+			return;
+		Client& client = found->second;
+		if (events & (net::Event_Read | net::Event_Hangup))
+		{
+			uint32_t id = found->first;
+			net::IoStatus status = client.connection.receive([id, &client, this](const wire::FrameHeader& header, const char* payload)
+				{
+					onFrame(id, client, header, payload);
+				});
+			if (status == net::Io_Closed || status == net::Io_Error)
+			{
+				dropped.push_back(found->first);
+				return;
+			}
+		}
+		if (events & net::Event_Write)
+			flush(found->first, client);
+	}
+
+	void accept()
+	{
+		while (true)
+		{
+			net::Socket socket = listener.accept();
+			if (!socket.isOpen())
+				return;
+			uint32_t id = next_id++;
+			Client& client = clients[id];
+			client.connection = Connection(std::move(socket));
+			client.token = uint32_t(random());
+			if (!loop.add(client.connection.socket.get(), net::Event_Read, id))
+			{
+				clients.erase(id);
+				continue;
+			}
+			wire::putWelcome(client.connection.outgoing(), wire::Welcome{ id, client.token });
+			flush(id, client);
+			stats.accepted++;
+		}
+	}
+
+	void onFrame(uint32_t id, Client& client, const wire::FrameHeader& header, const char* payload)
+	{
+		if (header.type == wire::Msg_Player)
+		{
+			PlayerView view;
+			const char* cursor = payload;
+			if (!SerializedPlayer::decode(cursor, payload + header.length, view))
+				return;
+			if (!client.has_udp)
+				client.location = view.location;
+			if (!client.joined)
+			{
+				client.name = view.nameString();
+				client.joined = true;
+				announce(id, client);
+			}
+		}
+		else if (header.type == wire::Msg_Ack)
+		{
+			const char* cursor = payload;
+			uint32_t acked = 0;
+			if (wire::getVarint(cursor, payload + header.length, acked) && acked <= sequence && acked > client.acked)
+				client.acked = acked;
+		}
+	}
+
+	//Tells everybody about a new player, and the new player about everybody
+	void announce(uint32_t joined_id, Client& joined)
+	{
+		for (auto& entry : clients)
+		{
+			Client& other = entry.second;
+			if (&other == &joined || !other.joined)
+				continue;
+			wire::putJoin(other.connection.outgoing(), joined_id, joined.name);
+			wire::putJoin(joined.connection.outgoing(), entry.first, other.name);
+			flush(entry.first, other);
+		}
+		flush(joined_id, joined);
+	}
+
+	void receiveDatagrams()
+	{
+		size_t received = 0;
+		net::Address from;
+		while (udp.receiveFrom(datagram.data(), datagram.size(), received, from) == net::Io_Ok)
+		{
+			wire::forEachFrame(datagram.data(), received, [&](const wire::FrameHeader& header, const char* payload)
+				{
+					wire::LocationUpdate update;
+					if (header.type != wire::Msg_Location || !wire::getLocation(payload, header.length, update))
+						return;
+					auto found = clients.find(update.id);
+					if (found == clients.end() || found->second.token != update.token)
+						return;
+					Client& client = found->second;
+					if (client.has_udp && !wire::isNewer(update.sequence, client.location_sequence))
+					{
+						stats.stale_locations++;
+						return;
+					}
+					client.location_sequence = update.sequence;
+					client.udp_address = from;
+					client.has_udp = true;
+					if (client.joined)
+						client.location = update.location;
+					if (update.ack <= sequence && update.ack > client.acked)
+						client.acked = update.ack;
+				});
+		}
+	}
+
+	//Sends a snapshot frame over UDP together with the client's last few, oldest first: the client decodes the
+	//ones it is missing and drops the rest as stale
+	bool sendDatagram(Client& client, const char* frame, size_t length)
+	{
+		size_t recent_bytes = client.recent.size();
+		if (recent_bytes + length > wire::Max_Datagram_Size)
+		{
+			client.recent.clear();
+			client.recent_sizes.clear();
+			recent_bytes = 0;
+			if (length > wire::Max_Datagram_Size)
+				return false;
+		}
+		client.recent.insert(client.recent.end(), frame, frame + length);
+		client.recent_sizes.push_back(length);
+		udp.sendTo(client.recent.data(), client.recent.size(), client.udp_address);
+		stats.udp_bytes_out += client.recent.size();
+
+		if (client.recent_sizes.size() > size_t(redundancy))
+		{
+			client.recent.erase(client.recent.begin(), client.recent.begin() + client.recent_sizes.front());
+			client.recent_sizes.erase(client.recent_sizes.begin());
+		}
+		return true;
+	}
+
+	void flush(uint32_t id, Client& client)
+	{
+		if (client.connection.flush() == net::Io_Error)
+		{
+			dropped.push_back(id);
+			return;
+		}
+		bool want = client.connection.wantsWrite();
+		if (want != client.watching_write)
+		{
+			loop.modify(client.connection.socket.get(), net::Event_Read | (want ? net::Event_Write : 0), id);
+			client.watching_write = want;
+		}
+	}
+
+	void dropClients()
+	{
+		//By index: telling the others can fail and add to dropped, which then drops those clients in this loop too
+		for (size_t i = 0; i < dropped.size(); i++)
+		{
+			uint32_t id = dropped[i];
+			auto found = clients.find(id);
+			if (found == clients.end())
+				continue;
+			loop.remove(found->second.connection.socket.get());
+			bool joined = found->second.joined;
+			clients.erase(found);
+			stats.disconnected++;
+			if (!joined)
+				continue;
+			for (auto& entry : clients)
+			{
+				wire::putLeave(entry.second.connection.outgoing(), id);
+				flush(entry.first, entry.second);
+			}
+		}
+		dropped.clear();
+	}
+
+	const DeltaSnapshot* baseline(uint32_t acked) const
+	{
+		if (acked == 0 || sequence - acked >= Delta_Ring_Size)
+			return nullptr;
+		const DeltaSnapshot& s = history[acked % Delta_Ring_Size];
+		return s.sequence == acked ? &s : nullptr;
+	}
+
+	//Sends the current world to every client
+	void broadcast()
+	{
+		sequence++;
+		DeltaSnapshot& snapshot = history[sequence % Delta_Ring_Size];
+		snapshot.sequence = sequence;
+		snapshot.players.clear();
+		for (const auto& entry : clients)
+		{
+			const Client& c = entry.second;
+			if (c.joined)
+				snapshot.players.push_back(QuantizedPlayer{ entry.first, wire::quantize(c.location.x),
+					wire::quantize(c.location.y), wire::quantize(c.location.z) });
+		}
+		if (snapshot.players.empty())
+			return;
+
+		auto name_of = [](uint32_t) -> const std::string* { return nullptr; };	//Names went out with Msg_Join
+		encoded.clear();
+		encoded_bytes.clear();
+		for (auto& entry : clients)
+		{
+			Client& client = entry.second;
+			const DeltaSnapshot* base = baseline(client.acked);
+			uint32_t base_sequence = base ? base->sequence : 0;
+
+			auto cached = std::find_if(encoded.begin(), encoded.end(), [base_sequence](const Encoded& e) { return e.base == base_sequence; });
+			if (cached == encoded.end())
+			{
+				Encoded e{ base_sequence, encoded_bytes.size() };
+				if (!DeltaEncoder::write(base, sequence, snapshot.players.data(), snapshot.players.size(), name_of, scratch, encoded_bytes))
+				{
+					//Too many players for one delta frame: every location by id, in frames that are never acknowledged
+					wire::putPositions(encoded_bytes, snapshot.players.data(), snapshot.players.size());
+				}
+				e.length = encoded_bytes.size() - e.offset;
+				encoded.push_back(e);
+				cached = encoded.end() - 1;
+				stats.encodes++;
+			}
+
+			const char* frame = encoded_bytes.data() + cached->offset;
+			stats.bytes_out += cached->length;
+			if (client.has_udp && sendDatagram(client, frame, cached->length))
+				continue;
+
+			if (client.connection.pendingBytes() > Max_Backlog)
+			{
+				dropped.push_back(entry.first);
+				continue;
+			}
+			client.connection.queue(frame, cached->length);
+			flush(entry.first, client);
+		}
+	}
+};
+
+int main(int argc, char** argv)
+{
+	uint16_t port = 27000;
+	double tick_rate = 60.0;
+	double seconds = 0.0;
+	int redundancy = 0;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--port") == 0)
+			port = uint16_t(atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "--tick-rate") == 0)
+			tick_rate = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "--seconds") == 0)
+			seconds = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "--redundancy") == 0)
+			redundancy = std::max(0, atoi(argv[i + 1]));
+	}
+	tick_rate = std::min(128.0, std::max(20.0, tick_rate));
+
+	if (!net::startup())
+		return 1;
+	GameServer server(tick_rate, redundancy);
+	if (!server.start(port))
+	{
+		fprintf(stderr, "Cannot listen on port %u\n", unsigned(port));
+		return 1;
+	}
+	printf("Listening on port %u, %.0f ticks per second\n", unsigned(port), tick_rate);
+
+	Clock::time_point end = seconds > 0.0 ? Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds))
+		: Clock::time_point::max();
+	while (Clock::now() < end)
+	{
+		server.stats = GameServer::Stats{};
+		server.run(std::min(end, Clock::now() + std::chrono::seconds(1)));
+		const GameServer::Stats& s = server.stats;
+		printf("clients %zu (+%lu -%lu) | ticks %lu, overruns %lu | tick avg %.3f ms, max %.3f ms | encodes/tick %.1f | out %.2f MB/s, udp %.2f MB/s | stale %lu\n",
+			server.clientCount(), s.accepted, s.disconnected, s.ticks, s.overruns, s.ticks ? s.busy_ms / s.ticks : 0.0,
+			s.max_tick_ms, s.ticks ? double(s.encodes) / s.ticks : 0.0, double(s.bytes_out) / (1024.0 * 1024.0),
+			double(s.udp_bytes_out) / (1024.0 * 1024.0), s.stale_locations);
+		fflush(stdout);
+	}
+	net::cleanup();
+	return 0;
+}
@@ -0,0 +1,288 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Load generator for GameServer: opens many simulated clients from one process. Every client walks around the
+// level, sends its player like 3D_World_Traversal does and acknowledges the snapshots it receives. After the
+// welcome, locations and snapshots go over UDP like in GameClient.
+//
+//    LoadGenerator [--clients 1000] [--address 127.0.0.1] [--port 27000] [--update-ms 50] [--seconds 30] [--decode 10]
+//                  [--loss 0]
+//
+// --loss drops that percentage of the UDP datagrams in both directions, to see how the game copes with a lossy link.
+//
+// Only the first --decode clients fully decode their snapshots (a decoder keeps a ring of whole snapshots, which
+// for a thousand players is too much memory to have a thousand times); the others just acknowledge them.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "../FirstExample/Connection.h"
+#include "../FirstExample/DeltaCodec.h"
+#include "../FirstExample/Player.h"
+#include "../FirstExample/PlayerSerializer.h"
+#include "../FirstExample/Session.h"
+#include "../FirstExample/Socket.h"
+#include "../FirstExample/WireFormat.h"
+
+using namespace sdds;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Bot
+{
+	Connection connection{};
+	Player player{};
+	bool connected{};
+	bool failed{};
+	bool watching_write{ true };	//Until the connect completes
+	uint32_t ack{};
+	std::unique_ptr<DeltaDecoder> decoder{};
+	Clock::time_point last_snapshot{};
+	net::Socket udp{};
+	wire::Welcome welcome{};
+	bool sent_once{};
+	uint32_t location_sequence{};
+};
+
+struct Stats
+{
+	unsigned long snapshots{};
+	unsigned long rejected{};		//Stale, duplicate or undecodable snapshots, decoding bots only
+	unsigned long dropped{};		//Datagrams thrown away to simulate --loss
+	unsigned long long bytes_in{};
+	std::vector<double> gaps_ms{};	//Time between snapshots, decoding bots only
+};
+
+int main(int argc, char** argv)
+{
+	size_t client_count = 1000;
+	const char* address = "127.0.0.1";
+	uint16_t port = 27000;
+	int update_ms = 50;
+	double seconds = 30.0;
+	size_t decode_count = 10;
+	double loss = 0.0;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--clients") == 0)
+			client_count = size_t(atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "--address") == 0)
+			address = argv[i + 1];
+		else if (strcmp(argv[i], "--port") == 0)
+			port = uint16_t(atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "--update-ms") == 0)
+			update_ms = std::max(1, atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "--seconds") == 0)
+			seconds = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "--decode") == 0)
+			decode_count = size_t(atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "--loss") == 0)
+			loss = atof(argv[i + 1]) / 100.0;
+	}
+
+	if (!net::startup())
+		return 1;
+	net::EventLoop loop{};
+	std::mt19937 random(12345);
+	std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+	std::uniform_real_distribution<double> chance(0.0, 1.0);
+	const uint64_t Udp_Bit = uint64_t(1) << 32;	//Event keys: bot index, with this bit for the bot's UDP socket
+
+	std::vector<Bot> bots(client_count);
+	for (size_t i = 0; i < bots.size(); i++)
+	{
+		Bot& bot = bots[i];
+		bot.player = Player(Location{ coordinate(random), coordinate(random), 0.0f }, "bot_" + std::to_string(i));
+		if (i < decode_count)
+			bot.decoder.reset(new DeltaDecoder());
+		bot.connection = Connection(net::Socket::connectTcp(address, port));
+		if (!bot.connection.socket.isOpen() || !loop.add(bot.connection.socket.get(), net::Event_Read | net::Event_Write, i))
+			bot.failed = true;
+	}
+
+	Stats stats{};
+	size_t lost = 0;
+	std::vector<char> datagram(65536);
+	std::vector<char> location;
+	auto on_frame = [&](Bot& bot, const wire::FrameHeader& header, const char* payload)
+	{
+		stats.bytes_in += wire::Frame_Header_Size + header.length;
+		if (header.type == wire::Msg_Welcome)
+		{
+			if (bot.udp.isOpen() || !wire::getWelcome(payload, header.length, bot.welcome))
+				return;
+			bot.udp = net::Socket::connectUdp(address, port);
+			if (bot.udp.isOpen())
+				loop.add(bot.udp.get(), net::Event_Read, uint64_t(&bot - bots.data()) | Udp_Bit);
+			return;
+		}
+		if (header.type != wire::Msg_Delta && header.type != wire::Msg_Positions)
+			return;
+		stats.snapshots++;
+		if (header.type != wire::Msg_Delta)
+			return;
+		if (bot.decoder)
+		{
+			if (!bot.decoder->decode(payload, header.length, [](const PlayerView&) {}, [](uint32_t) {}))
+			{
+				stats.rejected++;
+				return;
+			}
+			Clock::time_point now = Clock::now();
+			if (bot.last_snapshot != Clock::time_point{})
+				stats.gaps_ms.push_back(std::chrono::duration<double, std::milli>(now - bot.last_snapshot).count());
+			bot.last_snapshot = now;
+			bot.ack = bot.decoder->latestSequence();
+		}
+		else
+		{
+			const char* cursor = payload;
+			uint32_t sequence;
+			if (wire::getVarint(cursor, payload + header.length, sequence) && wire::isNewer(sequence, bot.ack))
+				bot.ack = sequence;
+		}
+	};
+
+	auto on_event = [&](uint64_t key, uint32_t events)
+	{
+		Bot& bot = bots[size_t(key & (Udp_Bit - 1))];
+		if (bot.failed)
+			return;
+		if (key & Udp_Bit)
+		{
+			size_t received = 0;
+			net::Address from;
+			while (bot.udp.receiveFrom(datagram.data(), datagram.size(), received, from) == net::Io_Ok)
+			{
+				if (chance(random) < loss)
+				{
+					stats.dropped++;
+					continue;
+				}
+				wire::forEachFrame(datagram.data(), received, [&](const wire::FrameHeader& header, const char* payload)
+					{
+						on_frame(bot, header, payload);
+					});
+			}
+			return;
+		}
+		if (!bot.connected && (events & (net::Event_Write | net::Event_Hangup)))
+		{
+			bot.connected = bot.connection.socket.connectResult();
+			if (!bot.connected)
+			{
+				bot.failed = true;
+				loop.remove(bot.connection.socket.get());
+				return;
+			}
+		}
+		if (events & (net::Event_Read | net::Event_Hangup))
+		{
+			net::IoStatus status = bot.connection.receive([&](const wire::FrameHeader& header, const char* payload)
+				{
+					on_frame(bot, header, payload);
+				});
+			if (status == net::Io_Closed || status == net::Io_Error)
+			{
+				bot.failed = true;
+				loop.remove(bot.connection.socket.get());
+				lost++;
+				return;
+			}
+		}
+		if (bot.connected && (events & net::Event_Write))
+			bot.connection.flush();
+		bool want = bot.connection.wantsWrite() || !bot.connected;
+		if (want != bot.watching_write)
+		{
+			loop.modify(bot.connection.socket.get(), net::Event_Read | (want ? net::Event_Write : 0), key);
+			bot.watching_write = want;
+		}
+	};
+
+	Clock::time_point start = Clock::now();
+	Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+	Clock::time_point next_update = start;
+	Clock::time_point next_report = start + std::chrono::seconds(1);
+	Stats total{};
+	while (Clock::now() < end)
+	{
+		int timeout = int(std::chrono::duration_cast<std::chrono::milliseconds>(next_update - Clock::now()).count());
+		loop.wait(std::max(0, timeout), on_event);
+
+		Clock::time_point now = Clock::now();
+		if (now >= next_update)
+		{
+			next_update = now + std::chrono::milliseconds(update_ms);
+			for (size_t i = 0; i < bots.size(); i++)
+			{
+				Bot& bot = bots[i];
+				if (!bot.connected || bot.failed)
+					continue;
+				bot.player.location.x = std::min(100.0f, std::max(-100.0f, bot.player.location.x + step(random)));
+				bot.player.location.y = std::min(100.0f, std::max(-100.0f, bot.player.location.y + step(random)));
+
+				if (bot.sent_once && bot.udp.isOpen())
+				{
+					location.clear();
+					wire::putLocation(location, wire::LocationUpdate{ bot.welcome.id, bot.welcome.token, ++bot.location_sequence,
+						bot.ack, bot.player.location });
+					size_t sent = 0;
+					if (chance(random) < loss)
+						stats.dropped++;
+					else
+						bot.udp.send(location.data(), location.size(), sent);
+					continue;
+				}
+				bot.sent_once = true;
+
+				std::vector<char>& out = bot.connection.outgoing();
+				SerializedPlayer::player_serializer(bot.player, out);
+				if (bot.ack != 0)
+				{
+					size_t at = out.size();
+					out.resize(at + wire::Frame_Header_Size + wire::Max_Varint_Size);
+					out.resize(at + wire::putAckFrame(out.data() + at, bot.ack));
+				}
+				on_event(i, net::Event_Write);
+			}
+		}
+
+		if (now >= next_report)
+		{
+			next_report += std::chrono::seconds(1);
+			size_t connected = 0, players_seen = 0, decoders = 0;
+			for (const Bot& bot : bots)
+			{
+				connected += bot.connected && !bot.failed;
+				if (bot.decoder && !bot.failed)
+				{
+					players_seen += bot.decoder->current().players.size();
+					decoders++;
+				}
+			}
+			std::sort(stats.gaps_ms.begin(), stats.gaps_ms.end());
+			double p50 = stats.gaps_ms.empty() ? 0.0 : stats.gaps_ms[stats.gaps_ms.size() / 2];
+			double p99 = stats.gaps_ms.empty() ? 0.0 : stats.gaps_ms[stats.gaps_ms.size() * 99 / 100];
+			printf("connected %zu, lost %zu | snapshots %lu/s, in %.2f MB/s, rejected %lu, dropped %lu | players seen %.0f | snapshot gap p50 %.1f ms, p99 %.1f ms\n",
+				connected, lost, stats.snapshots, double(stats.bytes_in) / (1024.0 * 1024.0), stats.rejected, stats.dropped,
+				decoders ? double(players_seen) / decoders : 0.0, p50, p99);
+			fflush(stdout);
+			total.snapshots += stats.snapshots;
+			total.bytes_in += stats.bytes_in;
+			stats = Stats{};
+		}
+	}
+
+	printf("total: %lu snapshots, %.2f MB received in %.0f s\n", total.snapshots, double(total.bytes_in) / (1024.0 * 1024.0), seconds);
+	net::cleanup();
+	return 0;
+}
@@ -38,8 +38,21 @@
 #include <stdlib.h>
 #include <string.h>
 
-/*	error reporting	*/
-char *result_string_pointer = "SOIL initialized";
+/*	error reporting, one per thread so that images can be loaded on several threads at once	*/
+#if defined(SOIL_THREAD_LOCAL)
+/*	given by the build	*/
+#elif defined(_MSC_VER)
+#define SOIL_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define SOIL_THREAD_LOCAL __thread
+#elif defined(__cplusplus) && __cplusplus >= 201103L
+#define SOIL_THREAD_LOCAL thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define SOIL_THREAD_LOCAL _Thread_local
+#else
+#error "SOIL.c needs thread-local storage for the result string; define SOIL_THREAD_LOCAL for this compiler"
+#endif
+SOIL_THREAD_LOCAL char *result_string_pointer = "SOIL initialized";
 
 /*	for loading cube maps	*/
 enum{
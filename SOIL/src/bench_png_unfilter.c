@@ -0,0 +1,154 @@
+/*
+   Benchmark for the PNG unfiltering in stb_image_aug.c (create_png_image).
+
+      bench_png_unfilter ../../FirstExample/apple.png ../../FirstExample/ground.png ...
+
+   Inflates the IDAT data of every file once, then times create_png_image()
+   alone on it and prints MB/s of pixels it writes, plus a checksum of the
+   pixels. Build it twice to see what the SSE2/SSSE3 row routines gain, e.g.
+   with gcc:
+
+      gcc -O2 bench_png_unfilter.c -o unfilter_simd -lm
+      gcc -O2 -DSTBI_NO_SIMD_KERNELS bench_png_unfilter.c -o unfilter_scalar -lm
+
+   Both builds must print the same checksums. Only non-interlaced 8-bit
+   images are timed; other files are skipped with a note.
+*/
+
+#include "stb_image_aug.c"
+#include <time.h>
+
+#ifdef _WIN32
+static double milliseconds(void)
+{
+   LARGE_INTEGER count, frequency;
+   QueryPerformanceCounter(&count);
+   QueryPerformanceFrequency(&frequency);
+   return count.QuadPart * 1000.0 / frequency.QuadPart;
+}
+#else
+static double milliseconds(void)
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+#endif
+
+static uint32 be32(const uint8 *p)
+{
+   return ((uint32) p[0] << 24) | ((uint32) p[1] << 16) | ((uint32) p[2] << 8) | p[3];
+}
+
+static uint8 *read_file(const char *path, uint32 *length)
+{
+   FILE *f = fopen(path, "rb");
+   uint8 *data;
+   long size;
+   if (!f) return NULL;
+   fseek(f, 0, SEEK_END);
+   size = ftell(f);
+   fseek(f, 0, SEEK_SET);
+   data = (uint8 *) malloc(size > 0 ? size : 1);
+   if (data && fread(data, 1, size, f) != (size_t) size) { free(data); data = NULL; }
+   fclose(f);
+   *length = (uint32) size;
+   return data;
+}
+
+// Fills in the image size and channels from IHDR and gathers the IDAT chunks.
+// Returns the zlib stream, or NULL with a reason.
+static uint8 *collect_idat(const uint8 *file, uint32 length, png *p, uint32 *idat_length, const char **why)
+{
+   static const uint8 signature[8] = { 137,80,78,71,13,10,26,10 };
+   uint8 *idat = NULL;
+   uint32 pos = 8, stored = 0;
+   int seen_header = 0;
+   *why = "not a PNG";
+   if (length < 8 || memcmp(file, signature, 8)) return NULL;
+   while (pos + 12 <= length) {
+      uint32 chunk = be32(file + pos);
+      const uint8 *type = file + pos + 4, *body = file + pos + 8;
+      if (chunk > length - pos - 12) break;
+      if (!memcmp(type, "IHDR", 4) && chunk >= 13) {
+         static const int channels[7] = { 1,0,3,1,2,0,4 };
+         if (body[8] != 8 || body[9] > 6 || !channels[body[9]] || body[12]) { *why = "not 8-bit or interlaced"; free(idat); return NULL; }
+         p->s.img_x = be32(body);
+         p->s.img_y = be32(body + 4);
+         p->s.img_n = channels[body[9]];
+         seen_header = 1;
+      } else if (!memcmp(type, "IDAT", 4)) {
+         uint8 *grown = (uint8 *) realloc(idat, stored + chunk + 1);
+         if (!grown) { *why = "out of memory"; free(idat); return NULL; }
+         idat = grown;
+         memcpy(idat + stored, body, chunk);
+         stored += chunk;
+      }
+      pos += chunk + 12;
+   }
+   if (!seen_header || !idat) { *why = "no IHDR or IDAT"; free(idat); return NULL; }
+   *idat_length = stored;
+   return idat;
+}
+
+int main(int argc, char **argv)
+{
+   double total_bytes = 0, total_ms = 0;
+   int i;
+   if (argc < 2) {
+      printf("usage: %s file.png ...\n", argv[0]);
+      return 1;
+   }
+   #ifdef STBI_SIMD_KERNELS
+   printf("row routines: %s\n", (cpu_features() & CPU_SSSE3) ? "SSSE3" : (cpu_features() & CPU_SSE2) ? "SSE2" : "scalar (no SSE2)");
+   #else
+   printf("row routines: scalar (STBI_NO_SIMD_KERNELS or STBI_SIMD)\n");
+   #endif
+
+   for (i = 1; i < argc; ++i) {
+      uint32 file_length, idat_length = 0, k;
+      int raw_length, reps, r;
+      uint8 *file = read_file(argv[i], &file_length), *idat, *raw;
+      const char *why = "cannot read";
+      double bytes, start, ms;
+      unsigned long checksum = 5381;
+      png p;
+      memset(&p, 0, sizeof(p));
+
+      idat = file ? collect_idat(file, file_length, &p, &idat_length, &why) : NULL;
+      free(file);
+      raw = NULL;
+      if (idat) {
+         why = "bad zlib data";
+         raw = (uint8 *) stbi_zlib_decode_malloc((char *) idat, (int) idat_length, &raw_length);
+         free(idat);
+      }
+      if (!raw) { printf("%-32s skipped: %s\n", argv[i], why); continue; }
+      if (!create_png_image(&p, raw, (uint32) raw_length, p.s.img_n)) {
+         printf("%-32s skipped: %s\n", argv[i], stbi_failure_reason());
+         free(raw);
+         continue;
+      }
+      bytes = (double) p.s.img_x * p.s.img_y * p.s.img_n;
+      for (k = 0; k < (uint32) bytes; ++k)
+         checksum = checksum * 33 + p.out[k];
+      free(p.out);
+
+      // about 300 MB of output per file, at least 3 runs
+      reps = (int) (3e8 / bytes) + 3;
+      start = milliseconds();
+      for (r = 0; r < reps; ++r) {
+         create_png_image(&p, raw, (uint32) raw_length, p.s.img_n);
+         free(p.out);
+      }
+      ms = (milliseconds() - start) / reps;
+      printf("%-32s %5ux%-5u n=%d  %8.3f ms  %8.1f MB/s  checksum %08lx\n", argv[i], p.s.img_x, p.s.img_y, p.s.img_n,
+         ms, bytes / 1e3 / ms, checksum & 0xFFFFFFFFul);
+      total_bytes += bytes;
+      total_ms += ms;
+      free(raw);
+   }
+   if (total_ms > 0)
+      printf("all files: %.1f MB/s\n", total_bytes / 1e3 / total_ms);
+   return 0;
+}
@@ -14,6 +14,8 @@
       writes BMP,TGA (define STBI_NO_WRITE to remove code)
       decoded from memory or through stdio FILE (define STBI_NO_STDIO to remove code)
       supports installable dequantizing-IDCT, YCbCr-to-RGB conversion (define STBI_SIMD)
+      built-in SSE2/AVX2 JPEG IDCT, upsampling, YCbCr-to-RGB picked at runtime (define STBI_NO_SIMD_KERNELS to remove code)
+      built-in SSE2/SSSE3 PNG unfiltering for RGB/RGBA picked at runtime (same define)
 
    TODO:
       stbi_info_*
@@ -94,6 +96,11 @@ typedef   signed short  int16;
 typedef unsigned int   uint32;
 typedef   signed int    int32;
 typedef unsigned int   uint;
+#ifdef _MSC_VER
+typedef unsigned __int64 uint64;
+#else
+typedef unsigned long long uint64;
+#endif
 
 // should produce compiler error if size is wrong
 typedef unsigned char validate_uint32[sizeof(uint32)==4];
@@ -114,8 +121,21 @@ typedef unsigned char validate_uint32[sizeof(uint32)==4];
 // Generic API that works on all image types
 //
 
-// this is not threadsafe
-static char *failure_reason;
+// one per thread, so that images can be decoded on several threads at once
+#if defined(STBI_THREAD_LOCAL)
+// given by the build
+#elif defined(_MSC_VER)
+#define STBI_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define STBI_THREAD_LOCAL __thread
+#elif defined(__cplusplus) && __cplusplus >= 201103L
+#define STBI_THREAD_LOCAL thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define STBI_THREAD_LOCAL _Thread_local
+#else
+#error "stb_image_aug.c needs thread-local storage for the failure reason; define STBI_THREAD_LOCAL for this compiler"
+#endif
+static STBI_THREAD_LOCAL char *failure_reason;
 
 char *stbi_failure_reason(void)
 {
@@ -634,6 +654,15 @@ typedef struct
 
    int scan_n, order[4];
    int restart_interval, todo;
+
+   #if !STBI_SIMD
+   // kernels for this CPU, see setup_jpeg_kernels()
+   void (*idct_block_kernel)(uint8 *out, int out_stride, short data[64], uint8 *dequantize);
+   void (*YCbCr_to_RGB_kernel)(uint8 *out, uint8 *y, uint8 *pcb, uint8 *pcr, int count, int step);
+   uint8 *(*resample_row_v_2_kernel)(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs);
+   uint8 *(*resample_row_h_2_kernel)(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs);
+   uint8 *(*resample_row_hv_2_kernel)(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs);
+   #endif
 } jpeg;
 
 static int build_huffman(huffman *h, int *count)
@@ -1039,7 +1068,7 @@ static int parse_entropy_coded_data(jpeg *z)
             #if STBI_SIMD
             stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
             #else
-            idct_block(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
+            z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
             #endif
             // every data block is an MCU, so countdown the restart interval
             if (--z->todo <= 0) {
@@ -1069,7 +1098,7 @@ static int parse_entropy_coded_data(jpeg *z)
                      #if STBI_SIMD
                      stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
                      #else
-                     idct_block(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
+                     z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
                      #endif
                   }
                }
@@ -1417,6 +1446,578 @@ void stbi_install_YCbCr_to_RGB(stbi_YCbCr_to_RGB_run func)
 #endif
 
 
+//////////////////////////////////////////////////////////////////////////////
+//
+//  SSE2 / AVX2 versions of the JPEG kernels: IDCT, chroma upsampling and
+//  YCbCr->RGB. They do the same integer arithmetic as the scalar versions
+//  above, with the same rounding, so they produce exactly the same pixels;
+//  the scalar versions remain the reference and handle the row ends.
+//  setup_jpeg_kernels() picks the best set for the CPU at runtime.
+//  The PNG unfilter kernels further down share cpu_features().
+//  Define STBI_NO_SIMD_KERNELS to leave them out.
+//
+
+#if !STBI_SIMD && !defined(STBI_NO_SIMD_KERNELS) && \
+    (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define STBI_SIMD_KERNELS
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define STBI_TARGET_SSE2
+#define STBI_TARGET_SSSE3
+#define STBI_TARGET_AVX2
+#else
+#define STBI_TARGET_SSE2 __attribute__((target("sse2")))
+#define STBI_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define STBI_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+enum { CPU_SSE2 = 1, CPU_AVX2 = 2, CPU_SSSE3 = 4 };
+
+static int cpu_features(void)
+{
+   int features = 0;
+#ifdef _MSC_VER
+   int info[4], max_leaf;
+   __cpuid(info, 0);
+   max_leaf = info[0];
+   if (max_leaf < 1) return 0;
+   __cpuid(info, 1);
+   if (info[3] & (1 << 26)) features |= CPU_SSE2;
+   if (info[2] & (1 <<  9)) features |= CPU_SSSE3;
+   // AVX2 also needs the OS to save the YMM registers: OSXSAVE and AVX, then XCR0 bits 1 and 2
+   if (max_leaf >= 7 && (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6) {
+      __cpuidex(info, 7, 0);
+      if (info[1] & (1 << 5)) features |= CPU_AVX2;
+   }
+#else
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("sse2")) features |= CPU_SSE2;
+   if (__builtin_cpu_supports("ssse3")) features |= CPU_SSSE3;
+   if (__builtin_cpu_supports("avx2")) features |= CPU_AVX2;
+#endif
+   return features;
+}
+
+// The IDCT_1D macro with vector operations, all lanes 32 bits wide
+#define IDCT_1D_VEC(add,sub,mulc,shl12, s0,s1,s2,s3,s4,s5,s6,s7) \
+   p2 = s2;                                                      \
+   p3 = s6;                                                      \
+   p1 = mulc(add(p2,p3), f2f(0.5411961f));                       \
+   t2 = add(p1, mulc(p3, f2f(-1.847759065f)));                   \
+   t3 = add(p1, mulc(p2, f2f( 0.765366865f)));                   \
+   p2 = s0;                                                      \
+   p3 = s4;                                                      \
+   t0 = shl12(add(p2,p3));                                       \
+   t1 = shl12(sub(p2,p3));                                       \
+   x0 = add(t0,t3);                                              \
+   x3 = sub(t0,t3);                                              \
+   x1 = add(t1,t2);                                              \
+   x2 = sub(t1,t2);                                              \
+   t0 = s7;                                                      \
+   t1 = s5;                                                      \
+   t2 = s3;                                                      \
+   t3 = s1;                                                      \
+   p3 = add(t0,t2);                                              \
+   p4 = add(t1,t3);                                              \
+   p1 = add(t0,t3);                                              \
+   p2 = add(t1,t2);                                              \
+   p5 = mulc(add(p3,p4), f2f( 1.175875602f));                    \
+   t0 = mulc(t0, f2f( 0.298631336f));                            \
+   t1 = mulc(t1, f2f( 2.053119869f));                            \
+   t2 = mulc(t2, f2f( 3.072711026f));                            \
+   t3 = mulc(t3, f2f( 1.501321110f));                            \
+   p1 = add(p5, mulc(p1, f2f(-0.899976223f)));                   \
+   p2 = add(p5, mulc(p2, f2f(-2.562915447f)));                   \
+   p3 = mulc(p3, f2f(-1.961570560f));                            \
+   p4 = mulc(p4, f2f(-0.390180644f));                            \
+   t3 = add(t3, add(p1,p4));                                     \
+   t2 = add(t2, add(p2,p3));                                     \
+   t1 = add(t1, add(p2,p4));                                     \
+   t0 = add(t0, add(p1,p3));
+
+// SSE2 has no 32-bit multiply keeping the low half; two 32x32->64 multiplies give the same bits
+STBI_TARGET_SSE2 static __m128i mulc_sse2(__m128i a, int c)
+{
+   __m128i k = _mm_set1_epi32(c);
+   __m128i even = _mm_mul_epu32(a, k);
+   __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), k);
+   return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+}
+
+#define SSE2_ADD(a,b)   _mm_add_epi32(a,b)
+#define SSE2_SUB(a,b)   _mm_sub_epi32(a,b)
+#define SSE2_SHL12(a)   _mm_slli_epi32(a,12)
+
+#define TRANSPOSE4_SSE2(r0,r1,r2,r3)            \
+   {                                            \
+      __m128i a0 = _mm_unpacklo_epi32(r0, r1);  \
+      __m128i a1 = _mm_unpacklo_epi32(r2, r3);  \
+      __m128i a2 = _mm_unpackhi_epi32(r0, r1);  \
+      __m128i a3 = _mm_unpackhi_epi32(r2, r3);  \
+      r0 = _mm_unpacklo_epi64(a0, a1);          \
+      r1 = _mm_unpackhi_epi64(a0, a1);          \
+      r2 = _mm_unpacklo_epi64(a2, a3);          \
+      r3 = _mm_unpackhi_epi64(a2, a3);          \
+   }
+
+// one pass over four columns: in[k] holds row k, out[k] gets the k-th output, unshifted
+STBI_TARGET_SSE2 static void idct_pass_sse2(__m128i *v, int bias)
+{
+   __m128i t0,t1,t2,t3,p1,p2,p3,p4,p5,x0,x1,x2,x3;
+   __m128i b = _mm_set1_epi32(bias);
+   IDCT_1D_VEC(SSE2_ADD,SSE2_SUB,mulc_sse2,SSE2_SHL12, v[0],v[1],v[2],v[3],v[4],v[5],v[6],v[7])
+   x0 = _mm_add_epi32(x0, b); x1 = _mm_add_epi32(x1, b); x2 = _mm_add_epi32(x2, b); x3 = _mm_add_epi32(x3, b);
+   v[0] = _mm_add_epi32(x0,t3);
+   v[7] = _mm_sub_epi32(x0,t3);
+   v[1] = _mm_add_epi32(x1,t2);
+   v[6] = _mm_sub_epi32(x1,t2);
+   v[2] = _mm_add_epi32(x2,t1);
+   v[5] = _mm_sub_epi32(x2,t1);
+   v[3] = _mm_add_epi32(x3,t0);
+   v[4] = _mm_sub_epi32(x3,t0);
+}
+
+STBI_TARGET_SSE2 static void idct_block_sse2(uint8 *out, int out_stride, short data[64], uint8 *dequantize)
+{
+   __m128i lo[8], hi[8];   // columns 0-3 and 4-7 of each row, later of each column
+   __m128i zero = _mm_setzero_si128();
+   int i;
+
+   // dequantize: 16x16 multiplies, kept at full 32 bits like the scalar d*dq
+   for (i=0; i < 8; ++i) {
+      __m128i d = _mm_loadu_si128((__m128i *) (data + i*8));
+      __m128i q = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (dequantize + i*8)), zero);
+      __m128i pl = _mm_mullo_epi16(d, q), ph = _mm_mulhi_epi16(d, q);
+      lo[i] = _mm_unpacklo_epi16(pl, ph);
+      hi[i] = _mm_unpackhi_epi16(pl, ph);
+   }
+
+   // columns; the scalar shortcut for all-zero AC terms gives the same result as the full IDCT
+   idct_pass_sse2(lo, 512);
+   idct_pass_sse2(hi, 512);
+   for (i=0; i < 8; ++i) {
+      lo[i] = _mm_srai_epi32(lo[i], 10);
+      hi[i] = _mm_srai_epi32(hi[i], 10);
+   }
+
+   // rows: transpose so that each vector holds one column of four rows
+   TRANSPOSE4_SSE2(lo[0],lo[1],lo[2],lo[3]);
+   TRANSPOSE4_SSE2(lo[4],lo[5],lo[6],lo[7]);
+   TRANSPOSE4_SSE2(hi[0],hi[1],hi[2],hi[3]);
+   TRANSPOSE4_SSE2(hi[4],hi[5],hi[6],hi[7]);
+   {
+      // rows 0-3 are lo[0..3] (columns 0-3) and hi[0..3] (columns 4-7); rows 4-7 likewise in [4..7]
+      __m128i top[8], bottom[8];
+      for (i=0; i < 4; ++i) {
+         top[i] = lo[i]; top[i+4] = hi[i];
+         bottom[i] = lo[i+4]; bottom[i+4] = hi[i+4];
+      }
+      idct_pass_sse2(top, 65536);
+      idct_pass_sse2(bottom, 65536);
+
+      // top[k] now holds output column k of rows 0-3: shift, clamp, and transpose back to rows of bytes
+      for (i=0; i < 8; ++i) {
+         top[i] = _mm_srai_epi32(top[i], 17);
+         bottom[i] = _mm_srai_epi32(bottom[i], 17);
+      }
+      TRANSPOSE4_SSE2(top[0],top[1],top[2],top[3]);
+      TRANSPOSE4_SSE2(top[4],top[5],top[6],top[7]);
+      TRANSPOSE4_SSE2(bottom[0],bottom[1],bottom[2],bottom[3]);
+      TRANSPOSE4_SSE2(bottom[4],bottom[5],bottom[6],bottom[7]);
+      {
+         __m128i bias = _mm_set1_epi16(128);
+         for (i=0; i < 4; ++i) {
+            __m128i r0 = _mm_adds_epi16(_mm_packs_epi32(top[i], top[i+4]), bias);
+            __m128i r1 = _mm_adds_epi16(_mm_packs_epi32(bottom[i], bottom[i+4]), bias);
+            _mm_storel_epi64((__m128i *) (out + i*out_stride), _mm_packus_epi16(r0, r0));
+            _mm_storel_epi64((__m128i *) (out + (i+4)*out_stride), _mm_packus_epi16(r1, r1));
+         }
+      }
+   }
+}
+
+#define AVX2_ADD(a,b)   _mm256_add_epi32(a,b)
+#define AVX2_SUB(a,b)   _mm256_sub_epi32(a,b)
+#define AVX2_MULC(a,c)  _mm256_mullo_epi32(a,_mm256_set1_epi32(c))
+#define AVX2_SHL12(a)   _mm256_slli_epi32(a,12)
+
+STBI_TARGET_AVX2 static void transpose8_avx2(__m256i *r)
+{
+   __m256i a0 = _mm256_unpacklo_epi32(r[0], r[1]), a1 = _mm256_unpackhi_epi32(r[0], r[1]);
+   __m256i a2 = _mm256_unpacklo_epi32(r[2], r[3]), a3 = _mm256_unpackhi_epi32(r[2], r[3]);
+   __m256i a4 = _mm256_unpacklo_epi32(r[4], r[5]), a5 = _mm256_unpackhi_epi32(r[4], r[5]);
+   __m256i a6 = _mm256_unpacklo_epi32(r[6], r[7]), a7 = _mm256_unpackhi_epi32(r[6], r[7]);
+   __m256i b0 = _mm256_unpacklo_epi64(a0, a2), b1 = _mm256_unpackhi_epi64(a0, a2);
+   __m256i b2 = _mm256_unpacklo_epi64(a1, a3), b3 = _mm256_unpackhi_epi64(a1, a3);
+   __m256i b4 = _mm256_unpacklo_epi64(a4, a6), b5 = _mm256_unpackhi_epi64(a4, a6);
+   __m256i b6 = _mm256_unpacklo_epi64(a5, a7), b7 = _mm256_unpackhi_epi64(a5, a7);
+   r[0] = _mm256_permute2x128_si256(b0, b4, 0x20); r[4] = _mm256_permute2x128_si256(b0, b4, 0x31);
+   r[1] = _mm256_permute2x128_si256(b1, b5, 0x20); r[5] = _mm256_permute2x128_si256(b1, b5, 0x31);
+   r[2] = _mm256_permute2x128_si256(b2, b6, 0x20); r[6] = _mm256_permute2x128_si256(b2, b6, 0x31);
+   r[3] = _mm256_permute2x128_si256(b3, b7, 0x20); r[7] = _mm256_permute2x128_si256(b3, b7, 0x31);
+}
+
+STBI_TARGET_AVX2 static void idct_pass_avx2(__m256i *v, int bias)
+{
+   __m256i t0,t1,t2,t3,p1,p2,p3,p4,p5,x0,x1,x2,x3;
+   __m256i b = _mm256_set1_epi32(bias);
+   IDCT_1D_VEC(AVX2_ADD,AVX2_SUB,AVX2_MULC,AVX2_SHL12, v[0],v[1],v[2],v[3],v[4],v[5],v[6],v[7])
+   x0 = _mm256_add_epi32(x0, b); x1 = _mm256_add_epi32(x1, b); x2 = _mm256_add_epi32(x2, b); x3 = _mm256_add_epi32(x3, b);
+   v[0] = _mm256_add_epi32(x0,t3);
+   v[7] = _mm256_sub_epi32(x0,t3);
+   v[1] = _mm256_add_epi32(x1,t2);
+   v[6] = _mm256_sub_epi32(x1,t2);
+   v[2] = _mm256_add_epi32(x2,t1);
+   v[5] = _mm256_sub_epi32(x2,t1);
+   v[3] = _mm256_add_epi32(x3,t0);
+   v[4] = _mm256_sub_epi32(x3,t0);
+}
+
+STBI_TARGET_AVX2 static void idct_block_avx2(uint8 *out, int out_stride, short data[64], uint8 *dequantize)
+{
+   __m256i v[8];
+   __m128i bias = _mm_set1_epi16(128);
+   int i;
+   for (i=0; i < 8; ++i) {
+      __m256i d = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *) (data + i*8)));
+      __m256i q = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *) (dequantize + i*8)));
+      v[i] = _mm256_mullo_epi32(d, q);
+   }
+   idct_pass_avx2(v, 512);
+   for (i=0; i < 8; ++i)
+      v[i] = _mm256_srai_epi32(v[i], 10);
+   transpose8_avx2(v);
+   idct_pass_avx2(v, 65536);
+   for (i=0; i < 8; ++i)
+      v[i] = _mm256_srai_epi32(v[i], 17);
+   transpose8_avx2(v);
+   for (i=0; i < 8; ++i) {
+      __m128i r = _mm_adds_epi16(_mm_packs_epi32(_mm256_castsi256_si128(v[i]), _mm256_extracti128_si256(v[i], 1)), bias);
+      _mm_storel_epi64((__m128i *) (out + i*out_stride), _mm_packus_epi16(r, r));
+   }
+}
+
+// Upsampling. Each vector step handles the inputs i..i+N-1 of a row, which needs in[i-1] and in[i+N]: the
+// first and last inputs (and whatever is left at the end) go through the same formulas one at a time.
+
+STBI_TARGET_SSE2 static uint8 *resample_row_v_2_sse2(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
+{
+   int i = 0;
+   __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+   for (; i+16 <= w; i += 16) {
+      __m128i n = _mm_loadu_si128((__m128i *) (in_near + i)), f = _mm_loadu_si128((__m128i *) (in_far + i));
+      __m128i nl = _mm_unpacklo_epi8(n, zero), nh = _mm_unpackhi_epi8(n, zero);
+      __m128i fl = _mm_unpacklo_epi8(f, zero), fh = _mm_unpackhi_epi8(f, zero);
+      __m128i l = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_add_epi16(nl, nl), nl), _mm_add_epi16(fl, two)), 2);
+      __m128i h = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_add_epi16(nh, nh), nh), _mm_add_epi16(fh, two)), 2);
+      _mm_storeu_si128((__m128i *) (out + i), _mm_packus_epi16(l, h));
+   }
+   for (; i < w; ++i)
+      out[i] = div4(3*in_near[i] + in_far[i] + 2);
+   return out;
+}
+
+// even[j] and odd[j] are the two outputs of input j; stores them interleaved at out
+#define STORE_PAIRS_SSE2(out, even, odd) \
+   _mm_storeu_si128((__m128i *) (out), _mm_packus_epi16(_mm_unpacklo_epi16(even, odd), _mm_unpackhi_epi16(even, odd)))
+
+#define LOAD8_SSE2(p)  _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (p)), zero)
+
+STBI_TARGET_SSE2 static uint8 *resample_row_h_2_sse2(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
+{
+   int i;
+   uint8 *input = in_near;
+   __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+   if (w < 3)
+      return resample_row_h_2(out, in_near, in_far, w, hs);
+
+   out[0] = input[0];
+   out[1] = div4(input[0]*3 + input[1] + 2);
+   for (i=1; i+8 < w; i += 8) {
+      __m128i cur = LOAD8_SSE2(input + i);
+      __m128i n = _mm_add_epi16(_mm_add_epi16(_mm_add_epi16(cur, cur), cur), two);
+      __m128i even = _mm_srli_epi16(_mm_add_epi16(n, LOAD8_SSE2(input + i - 1)), 2);
+      __m128i odd = _mm_srli_epi16(_mm_add_epi16(n, LOAD8_SSE2(input + i + 1)), 2);
+      STORE_PAIRS_SSE2(out + i*2, even, odd);
+   }
+   for (; i < w-1; ++i) {
+      int n = 3*input[i]+2;
+      out[i*2+0] = div4(n+input[i-1]);
+      out[i*2+1] = div4(n+input[i+1]);
+   }
+   out[i*2+0] = div4(input[w-2]*3 + input[w-1] + 2);
+   out[i*2+1] = input[w-1];
+   return out;
+}
+
+STBI_TARGET_SSE2 static uint8 *resample_row_hv_2_sse2(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
+{
+   int i,t0,t1;
+   __m128i zero = _mm_setzero_si128(), eight = _mm_set1_epi16(8);
+   if (w < 3)
+      return resample_row_hv_2(out, in_near, in_far, w, hs);
+
+   // t(j) = 3*near[j] + far[j]; out[2j] = (3*t(j) + t(j-1) + 8) >> 4, out[2j+1] = (3*t(j) + t(j+1) + 8) >> 4
+   t1 = 3*in_near[0] + in_far[0];
+   out[0] = div4(t1+2);
+   out[1] = div16(3*t1 + 3*in_near[1] + in_far[1] + 8);
+   for (i=1; i+8 < w; i += 8) {
+      __m128i np = LOAD8_SSE2(in_near + i - 1), nc = LOAD8_SSE2(in_near + i), nn = LOAD8_SSE2(in_near + i + 1);
+      __m128i tp = _mm_add_epi16(_mm_add_epi16(_mm_add_epi16(np, np), np), LOAD8_SSE2(in_far + i - 1));
+      __m128i tc = _mm_add_epi16(_mm_add_epi16(_mm_add_epi16(nc, nc), nc), LOAD8_SSE2(in_far + i));
+      __m128i tn = _mm_add_epi16(_mm_add_epi16(_mm_add_epi16(nn, nn), nn), LOAD8_SSE2(in_far + i + 1));
+      __m128i c = _mm_add_epi16(_mm_add_epi16(_mm_add_epi16(tc, tc), tc), eight);
+      __m128i even = _mm_srli_epi16(_mm_add_epi16(c, tp), 4);
+      __m128i odd = _mm_srli_epi16(_mm_add_epi16(c, tn), 4);
+      STORE_PAIRS_SSE2(out + i*2, even, odd);
+   }
+   for (; i < w; ++i) {
+      t0 = 3*in_near[i-1] + in_far[i-1];
+      t1 = 3*in_near[i] + in_far[i];
+      out[i*2] = div16(3*t1 + t0 + 8);
+      if (i < w-1)
+         out[i*2+1] = div16(3*t1 + 3*in_near[i+1] + in_far[i+1] + 8);
+   }
+   out[w*2-1] = div4(t1+2);
+   return out;
+}
+
+STBI_TARGET_AVX2 static uint8 *resample_row_v_2_avx2(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
+{
+   int i = 0;
+   __m256i two = _mm256_set1_epi16(2);
+   for (; i+16 <= w; i += 16) {
+      __m256i n = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i f = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i r = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_add_epi16(n, n), n), _mm256_add_epi16(f, two)), 2);
+      _mm_storeu_si128((__m128i *) (out + i), _mm_packus_epi16(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1)));
+   }
+   for (; i < w; ++i)
+      out[i] = div4(3*in_near[i] + in_far[i] + 2);
+   return out;
+}
+
+// The unpacks work within 128-bit lanes, which keeps inputs 0-7 in the low lane and 8-15 in the high one:
+// out[0..15] and out[16..31] come out in order.
+#define STORE_PAIRS_AVX2(out, even, odd) \
+   _mm256_storeu_si256((__m256i *) (out), _mm256_packus_epi16(_mm256_unpacklo_epi16(even, odd), _mm256_unpackhi_epi16(even, odd)))
+
+#define LOAD16_AVX2(p)  _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (p)))
+
+STBI_TARGET_AVX2 static uint8 *resample_row_h_2_avx2(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
+{
+   int i;
+   uint8 *input = in_near;
+   __m256i two = _mm256_set1_epi16(2);
+   if (w < 3)
+      return resample_row_h_2(out, in_near, in_far, w, hs);
+
+   out[0] = input[0];
+   out[1] = div4(input[0]*3 + input[1] + 2);
+   for (i=1; i+16 < w; i += 16) {
+      __m256i cur = LOAD16_AVX2(input + i);
+      __m256i n = _mm256_add_epi16(_mm256_add_epi16(_mm256_add_epi16(cur, cur), cur), two);
+      __m256i even = _mm256_srli_epi16(_mm256_add_epi16(n, LOAD16_AVX2(input + i - 1)), 2);
+      __m256i odd = _mm256_srli_epi16(_mm256_add_epi16(n, LOAD16_AVX2(input + i + 1)), 2);
+      STORE_PAIRS_AVX2(out + i*2, even, odd);
+   }
+   for (; i < w-1; ++i) {
+      int n = 3*input[i]+2;
+      out[i*2+0] = div4(n+input[i-1]);
+      out[i*2+1] = div4(n+input[i+1]);
+   }
+   out[i*2+0] = div4(input[w-2]*3 + input[w-1] + 2);
+   out[i*2+1] = input[w-1];
+   return out;
+}
+
+STBI_TARGET_AVX2 static uint8 *resample_row_hv_2_avx2(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
+{
+   int i,t0,t1;
+   __m256i eight = _mm256_set1_epi16(8);
+   if (w < 3)
+      return resample_row_hv_2(out, in_near, in_far, w, hs);
+
+   t1 = 3*in_near[0] + in_far[0];
+   out[0] = div4(t1+2);
+   out[1] = div16(3*t1 + 3*in_near[1] + in_far[1] + 8);
+   for (i=1; i+16 < w; i += 16) {
+      __m256i np = LOAD16_AVX2(in_near + i - 1), nc = LOAD16_AVX2(in_near + i), nn = LOAD16_AVX2(in_near + i + 1);
+      __m256i tp = _mm256_add_epi16(_mm256_add_epi16(_mm256_add_epi16(np, np), np), LOAD16_AVX2(in_far + i - 1));
+      __m256i tc = _mm256_add_epi16(_mm256_add_epi16(_mm256_add_epi16(nc, nc), nc), LOAD16_AVX2(in_far + i));
+      __m256i tn = _mm256_add_epi16(_mm256_add_epi16(_mm256_add_epi16(nn, nn), nn), LOAD16_AVX2(in_far + i + 1));
+      __m256i c = _mm256_add_epi16(_mm256_add_epi16(_mm256_add_epi16(tc, tc), tc), eight);
+      __m256i even = _mm256_srli_epi16(_mm256_add_epi16(c, tp), 4);
+      __m256i odd = _mm256_srli_epi16(_mm256_add_epi16(c, tn), 4);
+      STORE_PAIRS_AVX2(out + i*2, even, odd);
+   }
+   for (; i < w; ++i) {
+      t0 = 3*in_near[i-1] + in_far[i-1];
+      t1 = 3*in_near[i] + in_far[i];
+      out[i*2] = div16(3*t1 + t0 + 8);
+      if (i < w-1)
+         out[i*2+1] = div16(3*t1 + 3*in_near[i+1] + in_far[i+1] + 8);
+   }
+   out[w*2-1] = div4(t1+2);
+   return out;
+}
+
+// YCbCr->RGB. The scalar constants do not fit in 16 bits, so each is split into a multiple of 65536 (folded into
+// the 16-bit sum that gets shifted up) and a 16-bit remainder (a pmaddwd over the cr,cb pairs):
+//    r = ((y + cr) << 16)   + 32768 + cr*(K_R - 65536)
+//    g = ((y - cr) << 16)   + 32768 + cr*(65536 - K_GCR) - cb*K_GCB
+//    b = ((y + 2*cb) << 16) + 32768 + cb*(K_B - 131072)
+#define K_R    float2fixed(1.40200f)
+#define K_GCR  float2fixed(0.71414f)
+#define K_GCB  float2fixed(0.34414f)
+#define K_B    float2fixed(1.77200f)
+
+// pairs of 16-bit constants for pmaddwd, the first one multiplies cr, the second one cb
+#define CRCB_PAIR(kcr, kcb)  ((int) (((unsigned) (kcb) << 16) | ((unsigned) (kcr) & 0xffff)))
+
+// 8 pixels: y, cr, cb as 16-bit lanes (cr and cb already minus 128) -> r, g, b as 16-bit lanes
+#define YCBCR_8_SSE2(y, cr, cb, r, g, b)                                                                       \
+   {                                                                                                          \
+      __m128i crcb_lo = _mm_unpacklo_epi16(cr, cb), crcb_hi = _mm_unpackhi_epi16(cr, cb);                     \
+      __m128i yr = _mm_add_epi16(y, cr), yg = _mm_sub_epi16(y, cr), yb = _mm_add_epi16(y, _mm_add_epi16(cb, cb)); \
+      r = _mm_packs_epi32(                                                                                    \
+         _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(zero, yr), round), _mm_madd_epi16(crcb_lo, kr)), 16), \
+         _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(zero, yr), round), _mm_madd_epi16(crcb_hi, kr)), 16)); \
+      g = _mm_packs_epi32(                                                                                    \
+         _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(zero, yg), round), _mm_madd_epi16(crcb_lo, kg)), 16), \
+         _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(zero, yg), round), _mm_madd_epi16(crcb_hi, kg)), 16)); \
+      b = _mm_packs_epi32(                                                                                    \
+         _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(zero, yb), round), _mm_madd_epi16(crcb_lo, kb)), 16), \
+         _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(zero, yb), round), _mm_madd_epi16(crcb_hi, kb)), 16)); \
+   }
+
+// 16 pixels of r, g, b bytes -> 64 bytes of RGBA
+#define STORE_RGBA_SSE2(dst, r, g, b)                                                     \
+   {                                                                                      \
+      __m128i rg_lo = _mm_unpacklo_epi8(r, g), rg_hi = _mm_unpackhi_epi8(r, g);           \
+      __m128i ba_lo = _mm_unpacklo_epi8(b, alpha), ba_hi = _mm_unpackhi_epi8(b, alpha);   \
+      _mm_storeu_si128((__m128i *) (dst +  0), _mm_unpacklo_epi16(rg_lo, ba_lo));         \
+      _mm_storeu_si128((__m128i *) (dst + 16), _mm_unpackhi_epi16(rg_lo, ba_lo));         \
+      _mm_storeu_si128((__m128i *) (dst + 32), _mm_unpacklo_epi16(rg_hi, ba_hi));         \
+      _mm_storeu_si128((__m128i *) (dst + 48), _mm_unpackhi_epi16(rg_hi, ba_hi));         \
+   }
+
+// RGBA for 16 pixels goes to out directly (step 4) or through rgba (step 3), then the scalar code does the rest
+static void YCbCr_store_run(uint8 *out, uint8 *rgba, int step)
+{
+   int i;
+   if (step == 4) return;
+   for (i=0; i < 16; ++i) {
+      out[i*3+0] = rgba[i*4+0];
+      out[i*3+1] = rgba[i*4+1];
+      out[i*3+2] = rgba[i*4+2];
+   }
+}
+
+STBI_TARGET_SSE2 static void YCbCr_to_RGB_row_sse2(uint8 *out, uint8 *y, uint8 *pcb, uint8 *pcr, int count, int step)
+{
+   int i = 0;
+   uint8 rgba[64];
+   __m128i zero = _mm_setzero_si128(), alpha = _mm_set1_epi8(-1);
+   __m128i bias = _mm_set1_epi16(128), round = _mm_set1_epi32(32768);
+   __m128i kr = _mm_set1_epi32(CRCB_PAIR(K_R - 65536, 0));
+   __m128i kg = _mm_set1_epi32(CRCB_PAIR(65536 - K_GCR, -K_GCB));
+   __m128i kb = _mm_set1_epi32(CRCB_PAIR(0, K_B - 131072));
+   if (step == 3 || step == 4) {
+      for (; i+16 <= count; i += 16) {
+         __m128i yv = _mm_loadu_si128((__m128i *) (y + i));
+         __m128i cbv = _mm_loadu_si128((__m128i *) (pcb + i));
+         __m128i crv = _mm_loadu_si128((__m128i *) (pcr + i));
+         __m128i r0,g0,b0,r1,g1,b1;
+         uint8 *dst = step == 4 ? out : rgba;
+         YCBCR_8_SSE2(_mm_unpacklo_epi8(yv, zero), _mm_sub_epi16(_mm_unpacklo_epi8(crv, zero), bias),
+                      _mm_sub_epi16(_mm_unpacklo_epi8(cbv, zero), bias), r0, g0, b0);
+         YCBCR_8_SSE2(_mm_unpackhi_epi8(yv, zero), _mm_sub_epi16(_mm_unpackhi_epi8(crv, zero), bias),
+                      _mm_sub_epi16(_mm_unpackhi_epi8(cbv, zero), bias), r1, g1, b1);
+         r0 = _mm_packus_epi16(r0, r1);
+         g0 = _mm_packus_epi16(g0, g1);
+         b0 = _mm_packus_epi16(b0, b1);
+         STORE_RGBA_SSE2(dst, r0, g0, b0);
+         YCbCr_store_run(out, rgba, step);
+         out += 16*step;
+      }
+   }
+   YCbCr_to_RGB_row(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+
+STBI_TARGET_AVX2 static void YCbCr_to_RGB_row_avx2(uint8 *out, uint8 *y, uint8 *pcb, uint8 *pcr, int count, int step)
+{
+   int i = 0;
+   uint8 rgba[64];
+   __m256i zero = _mm256_setzero_si256(), round = _mm256_set1_epi32(32768), bias = _mm256_set1_epi16(128);
+   __m256i kr = _mm256_set1_epi32(CRCB_PAIR(K_R - 65536, 0));
+   __m256i kg = _mm256_set1_epi32(CRCB_PAIR(65536 - K_GCR, -K_GCB));
+   __m256i kb = _mm256_set1_epi32(CRCB_PAIR(0, K_B - 131072));
+   __m128i alpha = _mm_set1_epi8(-1);
+   if (step == 3 || step == 4) {
+      for (; i+16 <= count; i += 16) {
+         __m256i yv = LOAD16_AVX2(y + i);
+         __m256i cr = _mm256_sub_epi16(LOAD16_AVX2(pcr + i), bias);
+         __m256i cb = _mm256_sub_epi16(LOAD16_AVX2(pcb + i), bias);
+         __m256i crcb_lo = _mm256_unpacklo_epi16(cr, cb), crcb_hi = _mm256_unpackhi_epi16(cr, cb);
+         __m256i yr = _mm256_add_epi16(yv, cr), yg = _mm256_sub_epi16(yv, cr), yb = _mm256_add_epi16(yv, _mm256_add_epi16(cb, cb));
+         // in-lane unpacks and packs: the 16-bit results come back in pixel order
+         __m256i r = _mm256_packs_epi32(
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_unpacklo_epi16(zero, yr), round), _mm256_madd_epi16(crcb_lo, kr)), 16),
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_unpackhi_epi16(zero, yr), round), _mm256_madd_epi16(crcb_hi, kr)), 16));
+         __m256i g = _mm256_packs_epi32(
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_unpacklo_epi16(zero, yg), round), _mm256_madd_epi16(crcb_lo, kg)), 16),
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_unpackhi_epi16(zero, yg), round), _mm256_madd_epi16(crcb_hi, kg)), 16));
+         __m256i b = _mm256_packs_epi32(
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_unpacklo_epi16(zero, yb), round), _mm256_madd_epi16(crcb_lo, kb)), 16),
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_unpackhi_epi16(zero, yb), round), _mm256_madd_epi16(crcb_hi, kb)), 16));
+         __m128i r8 = _mm_packus_epi16(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1));
+         __m128i g8 = _mm_packus_epi16(_mm256_castsi256_si128(g), _mm256_extracti128_si256(g, 1));
+         __m128i b8 = _mm_packus_epi16(_mm256_castsi256_si128(b), _mm256_extracti128_si256(b, 1));
+         uint8 *dst = step == 4 ? out : rgba;
+         STORE_RGBA_SSE2(dst, r8, g8, b8);
+         YCbCr_store_run(out, rgba, step);
+         out += 16*step;
+      }
+   }
+   YCbCr_to_RGB_row(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif // STBI_SIMD_KERNELS
+
+#if !STBI_SIMD
+static void setup_jpeg_kernels(jpeg *z)
+{
+   z->idct_block_kernel = idct_block;
+   z->YCbCr_to_RGB_kernel = YCbCr_to_RGB_row;
+   z->resample_row_v_2_kernel = resample_row_v_2;
+   z->resample_row_h_2_kernel = resample_row_h_2;
+   z->resample_row_hv_2_kernel = resample_row_hv_2;
+   #ifdef STBI_SIMD_KERNELS
+   {
+      int features = cpu_features();
+      if (features & CPU_SSE2) {
+         z->idct_block_kernel = idct_block_sse2;
+         z->YCbCr_to_RGB_kernel = YCbCr_to_RGB_row_sse2;
+         z->resample_row_v_2_kernel = resample_row_v_2_sse2;
+         z->resample_row_h_2_kernel = resample_row_h_2_sse2;
+         z->resample_row_hv_2_kernel = resample_row_hv_2_sse2;
+      }
+      if (features & CPU_AVX2) {
+         z->idct_block_kernel = idct_block_avx2;
+         z->YCbCr_to_RGB_kernel = YCbCr_to_RGB_row_avx2;
+         z->resample_row_v_2_kernel = resample_row_v_2_avx2;
+         z->resample_row_h_2_kernel = resample_row_h_2_avx2;
+         z->resample_row_hv_2_kernel = resample_row_hv_2_avx2;
+      }
+   }
+   #endif
+}
+#endif
+
+
 // clean up the temporary component buffers
 static void cleanup_jpeg(jpeg *j)
 {
@@ -1449,6 +2050,9 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
    // validate req_comp
    if (req_comp < 0 || req_comp > 4) return epuc("bad req_comp", "Internal error");
    z->s.img_n = 0;
+   #if !STBI_SIMD
+   setup_jpeg_kernels(z);
+   #endif
 
    // load a jpeg image from whichever source
    if (!decode_jpeg_image(z)) { cleanup_jpeg(z); return NULL; }
@@ -1485,11 +2089,19 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
          r->ypos    = 0;
          r->line0   = r->line1 = z->img_comp[k].data;
 
+         #if !STBI_SIMD
+         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+         else if (r->hs == 1 && r->vs == 2) r->resample = z->resample_row_v_2_kernel;
+         else if (r->hs == 2 && r->vs == 1) r->resample = z->resample_row_h_2_kernel;
+         else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+         else                               r->resample = resample_row_generic;
+         #else
          if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
          else if (r->hs == 1 && r->vs == 2) r->resample = resample_row_v_2;
          else if (r->hs == 2 && r->vs == 1) r->resample = resample_row_h_2;
          else if (r->hs == 2 && r->vs == 2) r->resample = resample_row_hv_2;
          else                               r->resample = resample_row_generic;
+         #endif
       }
 
       // can't error after this so, this is safe
@@ -1519,7 +2131,7 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
                #if STBI_SIMD
                stbi_YCbCr_installed(out, y, coutput[1], coutput[2], z->s.img_x, n);
                #else
-               YCbCr_to_RGB_row(out, y, coutput[1], coutput[2], z->s.img_x, n);
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s.img_x, n);
                #endif
             } else
                for (i=0; i < z->s.img_x; ++i) {
@@ -1601,17 +2213,19 @@ extern int      stbi_jpeg_info_from_memory(stbi_uc const *buffer, int len, int *
 //      - all input must be provided in an upfront buffer
 //      - all output is written to a single output buffer (can malloc/realloc)
 //    performance
-//      - fast huffman
+//      - fast huffman, symbol and code length from one table lookup
+//      - 64-bit bit buffer refilled a word at a time
+//      - literal/length fast loop with word-at-a-time match copy
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
-#define ZFAST_BITS  9 // accelerate all cases in default tables
+#define ZFAST_BITS  11 // accelerate all cases in default tables, and nearly all in typical dynamic ones
 #define ZFAST_MASK  ((1 << ZFAST_BITS) - 1)
 
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
 {
-   uint16 fast[1 << ZFAST_BITS];
+   uint16 fast[1 << ZFAST_BITS]; // (code length << 9) | symbol, 0 if the code is longer than ZFAST_BITS
    uint16 firstcode[16];
    int maxcode[17];
    uint16 firstsymbol[16];
@@ -1643,7 +2257,7 @@ static int zbuild_huffman(zhuffman *z, uint8 *sizelist, int num)
 
    // DEFLATE spec for generating codes
    memset(sizes, 0, sizeof(sizes));
-   memset(z->fast, 255, sizeof(z->fast));
+   memset(z->fast, 0, sizeof(z->fast));
    for (i=0; i < num; ++i)
       ++sizes[sizelist[i]];
    sizes[0] = 0;
@@ -1671,7 +2285,7 @@ static int zbuild_huffman(zhuffman *z, uint8 *sizelist, int num)
          if (s <= ZFAST_BITS) {
             int k = bit_reverse(next_code[s],s);
             while (k < (1 << ZFAST_BITS)) {
-               z->fast[k] = (uint16) c;
+               z->fast[k] = (uint16) ((s << 9) | i);
                k += (1 << s);
             }
          }
@@ -1691,7 +2305,8 @@ typedef struct
 {
    uint8 *zbuffer, *zbuffer_end;
    int num_bits;
-   uint32 code_buffer;
+   int zero_bytes;      // zero bytes fill_bits() made up past the end of the input
+   uint64 code_buffer;  // bits above num_bits may already hold the next input byte
 
    char *zout;
    char *zout_start;
@@ -1707,40 +2322,55 @@ __forceinline static int zget8(zbuf *z)
    return *z->zbuffer++;
 }
 
+__forceinline static uint64 zload64(uint8 *p)
+{
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__) || \
+    (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+   uint64 w;
+   memcpy(&w, p, 8);
+   return w;
+#else
+   return (uint64) p[0]       | (uint64) p[1] <<  8 | (uint64) p[2] << 16 | (uint64) p[3] << 24 |
+          (uint64) p[4] << 32 | (uint64) p[5] << 40 | (uint64) p[6] << 48 | (uint64) p[7] << 56;
+#endif
+}
+
+// tops the bit buffer up to at least 56 bits
 static void fill_bits(zbuf *z)
 {
-   do {
-      assert(z->code_buffer < (1U << z->num_bits));
-      z->code_buffer |= zget8(z) << z->num_bits;
-      z->num_bits += 8;
-   } while (z->num_bits <= 24);
+   if (z->zbuffer_end - z->zbuffer >= 8) {
+      // load 8 bytes and keep the whole ones that fit; the next load puts
+      // the same bits in the same place, so the partial byte does no harm
+      z->code_buffer |= zload64(z->zbuffer) << z->num_bits;
+      z->zbuffer += (63 - z->num_bits) >> 3;
+      z->num_bits |= 56;
+   } else {
+      do {
+         if (z->zbuffer < z->zbuffer_end)
+            z->code_buffer |= (uint64) *z->zbuffer++ << z->num_bits;
+         else
+            ++z->zero_bytes;
+         z->num_bits += 8;
+      } while (z->num_bits < 56);
+   }
 }
 
 __forceinline static unsigned int zreceive(zbuf *z, int n)
 {
    unsigned int k;
    if (z->num_bits < n) fill_bits(z);
-   k = z->code_buffer & ((1 << n) - 1);
+   k = (unsigned int) (z->code_buffer & ((1 << n) - 1));
    z->code_buffer >>= n;
    z->num_bits -= n;
    return k;
 }
 
-__forceinline static int zhuffman_decode(zbuf *a, zhuffman *z)
+static int zhuffman_decode_slowpath(zbuf *a, zhuffman *z)
 {
    int b,s,k;
-   if (a->num_bits < 16) fill_bits(a);
-   b = z->fast[a->code_buffer & ZFAST_MASK];
-   if (b < 0xffff) {
-      s = z->size[b];
-      a->code_buffer >>= s;
-      a->num_bits -= s;
-      return z->value[b];
-   }
-
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = bit_reverse(a->code_buffer, 16);
+   k = bit_reverse((int) (a->code_buffer & 0xffff), 16);
    for (s=ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -1753,6 +2383,20 @@ __forceinline static int zhuffman_decode(zbuf *a, zhuffman *z)
    return z->value[b];
 }
 
+__forceinline static int zhuffman_decode(zbuf *a, zhuffman *z)
+{
+   int b,s;
+   if (a->num_bits < 16) fill_bits(a);
+   b = z->fast[a->code_buffer & ZFAST_MASK];
+   if (b) {
+      s = b >> 9;
+      a->code_buffer >>= s;
+      a->num_bits -= s;
+      return b & 511;
+   }
+   return zhuffman_decode_slowpath(a, z);
+}
+
 static int expand(zbuf *z, int n)  // need to make room for n bytes
 {
    char *q;
@@ -1784,16 +2428,114 @@ static int dist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,
 static int dist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+// copies a match of len bytes from dist bytes back; may write up to 7 bytes past
+// the end of the match when dist >= 8, so the caller must leave that much room
+__forceinline static char *zcopy_match(char *out, int dist, int len)
+{
+   char *p = out - dist, *end = out + len;
+   if (dist >= 8) {
+      // each 8-byte chunk is fully written before it is read back
+      do {
+         memcpy(out, p, 8);
+         out += 8;
+         p += 8;
+      } while (out < end);
+   } else if (dist == 1) {
+      memset(out, *p, len);
+   } else {
+      while (out < end)
+         *out++ = *p++;
+   }
+   return end;
+}
+
+// Decodes as long as 8 input bytes are left and the output has room for the
+// longest match plus zcopy_match's overrun, with the bit buffer in locals.
+// Returns 1 at the end of the block, 0 on error, and 2 when it has to hand
+// over to the careful loop in parse_huffman_block.
+static int parse_huffman_fast(zbuf *a)
+{
+   uint64 bits = a->code_buffer;
+   int nbits = a->num_bits, result = 2;
+   uint8 *in = a->zbuffer;
+   char *out = a->zout;
+   uint16 *lfast = a->z_length.fast, *dfast = a->z_distance.fast;
+
+   // compares what is left rather than forming end - 8, which would point
+   // before the start of a small buffer
+   while (a->zbuffer_end - in >= 8 && a->zout_end - out >= 258 + 8) {
+      int z,s,len,dist;
+      // one refill covers a length code, its extra bits, a distance code and its extra bits: 15+5+15+13
+      bits |= zload64(in) << nbits;
+      in += (63 - nbits) >> 3;
+      nbits |= 56;
+
+      z = lfast[bits & ZFAST_MASK];
+      if (z) {
+         s = z >> 9;
+         bits >>= s;
+         nbits -= s;
+         z &= 511;
+      } else {
+         a->code_buffer = bits; a->num_bits = nbits;
+         z = zhuffman_decode_slowpath(a, &a->z_length);
+         bits = a->code_buffer; nbits = a->num_bits;
+      }
+      if (z < 256) {
+         if (z < 0) { result = e("bad huffman code","Corrupt PNG"); break; }
+         *out++ = (char) z;
+         continue;
+      }
+      if (z == 256) { result = 1; break; }
+
+      z -= 257;
+      s = length_extra[z];
+      len = length_base[z] + (int) (bits & ((1 << s) - 1));
+      bits >>= s;
+      nbits -= s;
+
+      z = dfast[bits & ZFAST_MASK];
+      if (z) {
+         s = z >> 9;
+         bits >>= s;
+         nbits -= s;
+         z &= 511;
+      } else {
+         a->code_buffer = bits; a->num_bits = nbits;
+         z = zhuffman_decode_slowpath(a, &a->z_distance);
+         bits = a->code_buffer; nbits = a->num_bits;
+         if (z < 0) { result = e("bad huffman code","Corrupt PNG"); break; }
+      }
+      s = dist_extra[z];
+      dist = dist_base[z] + (int) (bits & ((1 << s) - 1));
+      bits >>= s;
+      nbits -= s;
+      if (out - a->zout_start < dist) { result = e("bad dist","Corrupt PNG"); break; }
+      out = zcopy_match(out, dist, len);
+   }
+
+   a->code_buffer = bits;
+   a->num_bits = nbits;
+   a->zbuffer = in;
+   a->zout = out;
+   return result;
+}
+
 static int parse_huffman_block(zbuf *a)
 {
    for(;;) {
-      int z = zhuffman_decode(a, &a->z_length);
+      int z = parse_huffman_fast(a);
+      if (z != 2) return z;
+
+      // near the end of the input or output: one symbol at a time, with checks;
+      // a valid stream never reads more than two refills of zeros past its end
+      if (a->zero_bytes > 16) return e("unexpected end","Corrupt PNG");
+      z = zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return e("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (a->zout >= a->zout_end) if (!expand(a, 1)) return 0;
          *a->zout++ = (char) z;
       } else {
-         uint8 *p;
          int len,dist;
          if (z == 256) return 1;
          z -= 257;
@@ -1804,10 +2546,16 @@ static int parse_huffman_block(zbuf *a)
          dist = dist_base[z];
          if (dist_extra[z]) dist += zreceive(a, dist_extra[z]);
          if (a->zout - a->zout_start < dist) return e("bad dist","Corrupt PNG");
-         if (a->zout + len > a->zout_end) if (!expand(a, len)) return 0;
-         p = (uint8 *) (a->zout - dist);
-         while (len--)
-            *a->zout++ = *p++;
+         if (a->zout + len + 8 > a->zout_end) {
+            // too close to the end for zcopy_match's overrun
+            char *p;
+            if (a->zout + len > a->zout_end) if (!expand(a, len)) return 0;
+            p = a->zout - dist;
+            while (len--)
+               *a->zout++ = *p++;
+         } else {
+            a->zout = zcopy_match(a->zout, dist, len);
+         }
       }
    }
 }
@@ -1815,7 +2563,7 @@ static int parse_huffman_block(zbuf *a)
 static int compute_huffman_codes(zbuf *a)
 {
    static uint8 length_dezigzag[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
-   static zhuffman z_codelength; // static just to save stack space
+   zhuffman z_codelength; // on the stack so that images can be decoded on several threads at once
    uint8 lencodes[286+32+137];//padding for maximum single op
    uint8 codelength_sizes[19];
    int i,n;
@@ -1864,17 +2612,16 @@ static int parse_uncompressed_block(zbuf *a)
    int len,nlen,k;
    if (a->num_bits & 7)
       zreceive(a, a->num_bits & 7); // discard
-   // drain the bit-packed data into header
-   k = 0;
-   while (a->num_bits > 0) {
-      header[k++] = (uint8) (a->code_buffer & 255); // wtf this warns?
-      a->code_buffer >>= 8;
-      a->num_bits -= 8;
-   }
-   assert(a->num_bits == 0);
+   // give the whole bytes still in the bit buffer back to the input,
+   // except for zeros made up past its end
+   k = (a->num_bits >> 3) - a->zero_bytes;
+   if (k > 0) a->zbuffer -= k;
+   a->num_bits = 0;
+   a->code_buffer = 0;
+   a->zero_bytes = 0;
    // now fill header the normal way
-   while (k < 4)
-      header[k++] = (uint8) zget8(a);
+   for (k=0; k < 4; ++k)
+      header[k] = (uint8) zget8(a);
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return e("zlib corrupt","Corrupt PNG");
@@ -1900,18 +2647,25 @@ static int parse_zlib_header(zbuf *a)
    return 1;
 }
 
-// @TODO: should statically initialize these for optimal thread safety
-static uint8 default_length[288], default_distance[32];
-static void init_defaults(void)
+// fixed huffman code lengths from the DEFLATE spec: 0-143 are 8 bits, 144-255
+// are 9, 256-279 are 7, 280-287 are 8, and all 32 distances are 5;
+// initialized statically so that concurrent decodes never write them
+static uint8 default_length[288] =
+{
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,8,8,8,8,8,8,8,8
+};
+static uint8 default_distance[32] =
 {
-   int i;   // use <= to match clearly with spec
-   for (i=0; i <= 143; ++i)     default_length[i]   = 8;
-   for (   ; i <= 255; ++i)     default_length[i]   = 9;
-   for (   ; i <= 279; ++i)     default_length[i]   = 7;
-   for (   ; i <= 287; ++i)     default_length[i]   = 8;
-
-   for (i=0; i <=  31; ++i)     default_distance[i] = 5;
-}
+   5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5
+};
 
 static int parse_zlib(zbuf *a, int parse_header)
 {
@@ -1920,6 +2674,7 @@ static int parse_zlib(zbuf *a, int parse_header)
       if (!parse_zlib_header(a)) return 0;
    a->num_bits = 0;
    a->code_buffer = 0;
+   a->zero_bytes = 0;
    do {
       final = zreceive(a,1);
       type = zreceive(a,2);
@@ -1930,7 +2685,6 @@ static int parse_zlib(zbuf *a, int parse_header)
       } else {
          if (type == 1) {
             // use fixed code lengths
-            if (!default_distance[31]) init_defaults();
             if (!zbuild_huffman(&a->z_length  , default_length  , 288)) return 0;
             if (!zbuild_huffman(&a->z_distance, default_distance,  32)) return 0;
          } else {
@@ -2075,6 +2829,119 @@ static int paeth(int a, int b, int c)
    return c;
 }
 
+#ifdef STBI_SIMD_KERNELS
+// SSE2 / SSSE3 row routines for 3- and 4-channel images whose output has as
+// many channels as the file. Sub, Avg and Paeth depend on the pixel to the
+// left, so they work one pixel at a time with all channels in one register;
+// Up has no such dependency and works 16 bytes at a time.
+// Pixels move as 4-byte words. With 3 channels the spare byte spills into the
+// next pixel, which is written later, so only a row's last pixel (m = n) is
+// copied exactly.
+
+__forceinline static uint32 png_load_px(uint8 *p, int n)
+{
+   uint32 v = 0;
+   if (n == 4) memcpy(&v, p, 4); else memcpy(&v, p, 3);
+   return v;
+}
+
+__forceinline static void png_store_px(uint8 *p, uint32 v, int n)
+{
+   if (n == 4) memcpy(p, &v, 4); else memcpy(p, &v, 3);
+}
+
+STBI_TARGET_SSE2 static void unfilter_sub_sse2(uint8 *cur, uint8 *prior, uint8 *raw, int x, int n)
+{
+   __m128i a = _mm_setzero_si128();
+   int i;
+   for (i=0; i < x; ++i, cur += n, raw += n) {
+      int m = i+1 < x ? 4 : n;
+      a = _mm_add_epi8(a, _mm_cvtsi32_si128((int) png_load_px(raw, m)));
+      png_store_px(cur, (uint32) _mm_cvtsi128_si32(a), m);
+   }
+}
+
+STBI_TARGET_SSE2 static void unfilter_up_sse2(uint8 *cur, uint8 *prior, uint8 *raw, int x, int n)
+{
+   int i, len = x*n;
+   for (i=0; i+16 <= len; i += 16) {
+      __m128i r = _mm_loadu_si128((__m128i *) (raw + i));
+      __m128i b = _mm_loadu_si128((__m128i *) (prior + i));
+      _mm_storeu_si128((__m128i *) (cur + i), _mm_add_epi8(r, b));
+   }
+   for (; i < len; ++i)
+      cur[i] = raw[i] + prior[i];
+}
+
+STBI_TARGET_SSE2 static void unfilter_avg_sse2(uint8 *cur, uint8 *prior, uint8 *raw, int x, int n)
+{
+   __m128i a = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+   int i;
+   for (i=0; i < x; ++i, cur += n, prior += n, raw += n) {
+      int m = i+1 < x ? 4 : n;
+      __m128i b = _mm_cvtsi32_si128((int) png_load_px(prior, m));
+      // (a+b)>>1 without overflow: pavgb rounds up, so take off the odd bit
+      __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+      a = _mm_add_epi8(_mm_cvtsi32_si128((int) png_load_px(raw, m)), avg);
+      png_store_px(cur, (uint32) _mm_cvtsi128_si32(a), m);
+   }
+}
+
+// paeth() on 16-bit lanes: pa = |b-c|, pb = |a-c|, pc = |a+b-2c|, ties go to a, then b
+#define PAETH_SSE(ABS)                                                           \
+   __m128i zero = _mm_setzero_si128(), mask = _mm_set1_epi16(0xff);              \
+   __m128i a = zero, c = zero;                                                   \
+   int i;                                                                        \
+   for (i=0; i < x; ++i, cur += n, prior += n, raw += n) {                       \
+      int m = i+1 < x ? 4 : n;                                                   \
+      __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int) png_load_px(prior, m)), zero); \
+      __m128i d = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int) png_load_px(raw, m)), zero);   \
+      __m128i pa = _mm_sub_epi16(b, c);                                          \
+      __m128i pb = _mm_sub_epi16(a, c);                                          \
+      __m128i pc = _mm_add_epi16(pa, pb);                                        \
+      __m128i least, use_a, use_b, pred;                                         \
+      pa = ABS(pa); pb = ABS(pb); pc = ABS(pc);                                  \
+      least = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));                          \
+      use_a = _mm_cmpeq_epi16(pa, least);                                        \
+      use_b = _mm_andnot_si128(use_a, _mm_cmpeq_epi16(pb, least));               \
+      pred = _mm_or_si128(_mm_and_si128(use_a, a), _mm_and_si128(use_b, b));     \
+      pred = _mm_or_si128(pred, _mm_andnot_si128(_mm_or_si128(use_a, use_b), c)); \
+      a = _mm_and_si128(_mm_add_epi16(d, pred), mask);                           \
+      c = b;                                                                     \
+      png_store_px(cur, (uint32) _mm_cvtsi128_si32(_mm_packus_epi16(a, a)), m);  \
+   }
+
+#define ABS_SSE2(v)   _mm_max_epi16(v, _mm_sub_epi16(zero, v))
+#define ABS_SSSE3(v)  _mm_abs_epi16(v)
+
+STBI_TARGET_SSE2 static void unfilter_paeth_sse2(uint8 *cur, uint8 *prior, uint8 *raw, int x, int n)
+{
+   PAETH_SSE(ABS_SSE2)
+}
+
+STBI_TARGET_SSSE3 static void unfilter_paeth_ssse3(uint8 *cur, uint8 *prior, uint8 *raw, int x, int n)
+{
+   PAETH_SSE(ABS_SSSE3)
+}
+
+// unfilters a whole row with a vector routine if there is one for this
+// filter on this CPU; returns 0 to leave the row to the scalar loops
+static int unfilter_row_simd(int features, int filter, uint8 *cur, uint8 *prior, uint8 *raw, int x, int n)
+{
+   if (!(features & CPU_SSE2)) return 0;
+   switch (filter) {
+      case F_sub  : unfilter_sub_sse2(cur, prior, raw, x, n); return 1;
+      case F_up   : unfilter_up_sse2(cur, prior, raw, x, n); return 1;
+      case F_avg  : unfilter_avg_sse2(cur, prior, raw, x, n); return 1;
+      case F_paeth:
+         if (features & CPU_SSSE3) unfilter_paeth_ssse3(cur, prior, raw, x, n);
+         else                      unfilter_paeth_sse2(cur, prior, raw, x, n);
+         return 1;
+   }
+   return 0;
+}
+#endif // STBI_SIMD_KERNELS
+
 // create the png data from post-deflated data
 static int create_png_image(png *a, uint8 *raw, uint32 raw_len, int out_n)
 {
@@ -2082,6 +2949,9 @@ static int create_png_image(png *a, uint8 *raw, uint32 raw_len, int out_n)
    uint32 i,j,stride = s->img_x*out_n;
    int k;
    int img_n = s->img_n; // copy it into a local for later
+   #ifdef STBI_SIMD_KERNELS
+   int features = (img_n == out_n && (img_n == 3 || img_n == 4)) ? cpu_features() : 0;
+   #endif
    assert(out_n == s->img_n || out_n == s->img_n+1);
    a->out = (uint8 *) malloc(s->img_x * s->img_y * out_n);
    if (!a->out) return e("outofmem", "Out of memory");
@@ -2093,6 +2963,18 @@ static int create_png_image(png *a, uint8 *raw, uint32 raw_len, int out_n)
       if (filter > 4) return e("invalid filter","Corrupt PNG");
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
+      // rows without a filter are copied as they are
+      if (filter == F_none && img_n == out_n) {
+         memcpy(cur, raw, stride);
+         raw += stride;
+         continue;
+      }
+      #ifdef STBI_SIMD_KERNELS
+      if (features && unfilter_row_simd(features, filter, cur, prior, raw, s->img_x, img_n)) {
+         raw += stride;
+         continue;
+      }
+      #endif
       // handle first pixel explicitly
       for (k=0; k < img_n; ++k) {
          switch(filter) {
@@ -2311,7 +3193,9 @@ static int parse_png_file(png *z, int scan, int req_comp)
             uint32 raw_len;
             if (scan != SCAN_load) return 1;
             if (z->idata == NULL) return e("no IDAT","Corrupt PNG");
-            z->expanded = (uint8 *) stbi_zlib_decode_malloc((char *) z->idata, ioff, (int *) &raw_len);
+            // IHDR gives the exact size: one filter byte plus the pixels per row
+            raw_len = s->img_y * (s->img_x * s->img_n + 1);
+            z->expanded = (uint8 *) stbi_zlib_decode_malloc_guesssize((char *) z->idata, ioff, (int) raw_len, (int *) &raw_len);
             if (z->expanded == NULL) return 0; // zlib should set error
             free(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
@@ -2336,9 +3220,10 @@ static int parse_png_file(png *z, int scan, int req_comp)
          default:
             // if critical, fail
             if ((c.type & (1 << 29)) == 0) {
-               #ifndef STBI_NO_FAILURE_STRINGS
-               // not threadsafe
-               static char invalid_chunk[] = "XXXX chunk not known";
+               #if !defined(STBI_NO_FAILURE_STRINGS) && !defined(STBI_FAILURE_USERMSG)
+               // per thread, like failure_reason, which points into it; the
+               // user message that SOIL reports does not need it
+               static STBI_THREAD_LOCAL char invalid_chunk[] = "XXXX chunk not known";
                invalid_chunk[0] = (uint8) (c.type >> 24);
                invalid_chunk[1] = (uint8) (c.type >> 16);
                invalid_chunk[2] = (uint8) (c.type >>  8);
@@ -14,6 +14,7 @@
       writes BMP,TGA (define STBI_NO_WRITE to remove code)
       decoded from memory or through stdio FILE (define STBI_NO_STDIO to remove code)
       supports installable dequantizing-IDCT, YCbCr-to-RGB conversion (define STBI_SIMD)
+      built-in SSE2/AVX2 JPEG IDCT, upsampling, YCbCr-to-RGB picked at runtime (define STBI_NO_SIMD_KERNELS to remove code)
         
    TODO:
       stbi_info_*
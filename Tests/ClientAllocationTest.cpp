@@ -0,0 +1,170 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Counts the heap allocations of the client's networking once it has settled. Runs a GameClient against a
+// GameServer, with the same code on both sides of the queue as 3D_World_Traversal.cpp (RemotePlayers.h):
+// handle_communication() on a network thread and the top of refresh_screen() on the main thread, every 16 ms,
+// without the drawing. Every global operator new is counted, from all threads, once the warm-up is over.
+//
+//    ClientAllocationTest [--address 127.0.0.1] [--port 27000] [--warmup 3] [--seconds 5]
+//
+// Start a GameServer and some LoadGenerator bots first, e.g. LoadGenerator --clients 200 --seconds 60; players that
+// join or leave while counting allocate their slot and name, so keep the bots running until this is done.
+// Prints the updates received and the allocations counted, and exits with 1 if there were any allocations or no
+// updates.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+#include "../FirstExample/GameClient.h"
+#include "../FirstExample/RemotePlayers.h"
+#include "../FirstExample/SnapshotInterpolator.h"
+#include "../FirstExample/TripleBuffer.h"
+
+using namespace sdds;
+
+static std::atomic<unsigned long> allocations{};
+static std::atomic<bool> counting{};
+
+//Every form of the global operator new and delete is replaced, so none of them reaches the library's own
+static void* allocate(size_t size)
+{
+	if (counting.load(std::memory_order_relaxed))
+		allocations++;
+	void* p = std::malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+#ifdef __cpp_aligned_new
+//Over-aligned types: the block is over-allocated and the pointer malloc() returned is kept just below the result
+static void* allocate(size_t size, std::align_val_t alignment)
+{
+	size_t align = std::max(size_t(alignment), sizeof(void*));
+	char* block = static_cast<char*>(allocate(size + align));
+	char* p = block + align - reinterpret_cast<uintptr_t>(block) % align;
+	reinterpret_cast<void**>(p)[-1] = block;
+	return p;
+}
+
+static void release(void* p)
+{
+	if (p)
+		std::free(static_cast<void**>(p)[-1]);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void operator delete(void* p, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { release(p); }
+#endif
+
+static RemotePlayers remote_players{};
+static TripleBuffer<Location> local_location{};
+static SnapshotInterpolator::Settings remote_motion{};
+static GameClient game_client{};
+static Player this_player(Location(), "allocation_test");
+static unsigned long updates = 0;
+
+//handle_communication()
+static void communicate()
+{
+	auto on_player = [](const PlayerView& view)
+	{
+		remote_players.onPlayer(view, game_client.arrivalTime(), game_client.lastSnapshot());
+	};
+	auto on_leave = [](uint32_t id) { remote_players.onLeave(id); };
+	auto local_player = []() -> const Player&
+	{
+		remote_players.flush();
+		local_location.acquire();
+		this_player.location = local_location.readBuffer();
+		return this_player;
+	};
+	game_client.run(local_player, on_player, on_leave);
+}
+
+//refresh_screen(), with printPlayerInfo() replaced by a count and addPlayer() by a sum the compiler cannot drop
+static void frame(float x)
+{
+	static volatile float drawn = 0.0f;
+
+	local_location.writeBuffer() = Location{ x, 0.0f, 0.0f };
+	local_location.publish();
+
+	remote_players.apply([](RemotePlayer&) { updates++; });
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point latest_snapshot = game_client.lastSnapshot();
+	for (const RemotePlayer& remote : remote_players.all())
+		drawn = drawn + remote.motion.sample(now, latest_snapshot, remote_motion).x;
+}
+
+int main(int argc, char** argv)
+{
+	const char* address = "127.0.0.1";
+	uint16_t port = 27000;
+	double warmup = 3.0, seconds = 5.0;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (std::strcmp(argv[i], "--address") == 0)
+			address = argv[i + 1];
+		else if (std::strcmp(argv[i], "--port") == 0)
+			port = uint16_t(std::atoi(argv[i + 1]));
+		else if (std::strcmp(argv[i], "--warmup") == 0)
+			warmup = std::atof(argv[i + 1]);
+		else if (std::strcmp(argv[i], "--seconds") == 0)
+			seconds = std::atof(argv[i + 1]);
+	}
+
+	if (!net::startup())
+		return 1;
+	if (!game_client.connect(address, port))
+	{
+		std::printf("Cannot connect to %s:%u\n", address, unsigned(port));
+		return 1;
+	}
+	std::thread network(communicate);
+
+	float x = 0.0f;
+	auto run_for = [&x](double run_seconds)
+	{
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() +
+			std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(run_seconds));
+		while (std::chrono::steady_clock::now() < end)
+		{
+			x += 0.05f;
+			frame(x);
+			std::this_thread::sleep_for(std::chrono::milliseconds(16));
+		}
+	};
+	run_for(warmup);
+	unsigned long before = updates;
+	counting.store(true);
+	run_for(seconds);
+	counting.store(false);
+	unsigned long measured = updates - before;
+
+	std::printf("%s, %zu players, %lu updates in %.1f s, %lu allocations\n", game_client.usesUdp() ? "UDP" : "TCP only",
+		remote_players.all().size(), measured, seconds, allocations.load());
+	game_client.stop();
+	network.join();
+	return allocations.load() != 0 || measured == 0 ? 1 : 0;
+}
@@ -0,0 +1,378 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Headless benchmark for the instanced cube path of draw_level() (FirstExample/3D_World_Traversal.cpp). Renders a
+// level full of cubes into an offscreen framebuffer with the game's shaders (triangles.vert and triangles.frag), once
+// per object the way drawCube() does it (a model matrix upload and a draw call per cube) and once per batch the way
+// drawCubesInstanced() does it (the instances streamed into a buffer, one glDrawElementsInstanced), and times both.
+// The GL calls each path issues per frame are counted, and both paths must produce the same image.
+//
+//    InstancedDrawBenchmark [--cubes 10000] [--frames 50] [--width 1024] [--height 768] [--shaders ../FirstExample]
+//
+// The context comes from EGL without a window or a display (EGL_MESA_platform_surfaceless), so it runs anywhere Mesa
+// does; without a GPU Mesa renders with llvmpipe. Build it on Linux with e.g.
+//    g++ -std=c++14 -O2 -I../glm InstancedDrawBenchmark.cpp -o InstancedDrawBenchmark -lEGL -lGL
+// Prints the renderer, the GL calls, the CPU time spent submitting and the time to a finished frame per path.
+// Exits with 1 when there is no context, a shader does not build or the two images differ.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define GL_GLEXT_PROTOTYPES
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+#define BUFFER_OFFSET(x) ((const void*) (x))
+
+typedef std::chrono::steady_clock Clock;
+
+enum Attrib_IDs { vPosition = 0, vTexCoord = 1, vInstanceOffset = 2, vInstanceScale = 3 };
+enum : GLushort { Restart_Index = 0xFFFF };
+
+//Same layout as in 3D_World_Traversal.cpp
+struct CubeInstance
+{
+	glm::vec3 offset;
+	glm::vec3 scale;
+};
+
+//The level mesh of 3D_World_Traversal.cpp: the ground quad followed by the 6 faces of the cube
+static const GLfloat vertices[28][3] = {
+	{ -100.0f, -100.0f, 0.0f }, { 100.0f, -100.0f, 0.0f }, { 100.0f, 100.0f, 0.0f }, { -100.0f, 100.0f, 0.0f },
+	{ -0.45f, -0.45f, 0.01f }, { 0.45f, -0.45f, 0.01f }, { 0.45f, 0.45f, 0.01f }, { -0.45f, 0.45f, 0.01f },
+	{ -0.45f, -0.45f, 0.9f }, { 0.45f, -0.45f, 0.9f }, { 0.45f, 0.45f, 0.9f }, { -0.45f, 0.45f, 0.9f },
+	{ 0.45f, -0.45f, 0.01f }, { 0.45f, 0.45f, 0.01f }, { 0.45f, 0.45f, 0.9f }, { 0.45f, -0.45f, 0.9f },
+	{ -0.45f, -0.45f, 0.01f }, { -0.45f, 0.45f, 0.01f }, { -0.45f, 0.45f, 0.9f }, { -0.45f, -0.45f, 0.9f },
+	{ -0.45f, 0.45f, 0.01f }, { 0.45f, 0.45f, 0.01f }, { 0.45f, 0.45f, 0.9f }, { -0.45f, 0.45f, 0.9f },
+	{ -0.45f, -0.45f, 0.01f }, { 0.45f, -0.45f, 0.01f }, { 0.45f, -0.45f, 0.9f }, { -0.45f, -0.45f, 0.9f },
+};
+
+static GLfloat texture_coordinates[28][2];
+
+//MeshRegistry::quadStrips()
+static void quadStrips(GLushort first_vertex, int quad_count, std::vector<GLushort>& indices)
+{
+	for (int q = 0; q < quad_count; q++)
+	{
+		GLushort v = GLushort(first_vertex + 4 * q);
+		if (q > 0)
+			indices.push_back(Restart_Index);
+		indices.push_back(v);
+		indices.push_back(GLushort(v + 1));
+		indices.push_back(GLushort(v + 3));
+		indices.push_back(GLushort(v + 2));
+	}
+}
+
+static bool readFile(const std::string& path, std::string& text)
+{
+	std::ifstream in(path.c_str(), std::ios::binary);
+	std::stringstream contents;
+	contents << in.rdbuf();
+	text = contents.str();
+	return bool(in);
+}
+
+static GLuint buildProgram(const std::string& directory)
+{
+	static const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	static const char* const files[2] = { "/triangles.vert", "/triangles.frag" };
+	GLuint program = glCreateProgram();
+	for (int i = 0; i < 2; i++)
+	{
+		std::string source;
+		if (!readFile(directory + files[i], source))
+		{
+			std::printf("Cannot read %s%s\n", directory.c_str(), files[i]);
+			return 0;
+		}
+		const char* text = source.c_str();
+		GLuint shader = glCreateShader(types[i]);
+		glShaderSource(shader, 1, &text, nullptr);
+		glCompileShader(shader);
+		GLint compiled = 0;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+		if (!compiled)
+		{
+			char log[2048];
+			glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+			std::printf("%s: %s\n", files[i] + 1, log);
+			return 0;
+		}
+		glAttachShader(program, shader);
+	}
+	glLinkProgram(program);
+	GLint linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	return linked ? program : 0;
+}
+
+//A checkerboard, so texture coordinates that go wrong show up in the image
+static GLuint checkerTexture(GLubyte dark, GLubyte light)
+{
+	GLubyte texels[16][16][3];
+	for (int y = 0; y < 16; y++)
+		for (int x = 0; x < 16; x++)
+			std::memset(texels[y][x], ((x ^ y) & 4) ? light : dark, 3);
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 16, 16, 0, GL_RGB, GL_UNSIGNED_BYTE, texels);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	return texture;
+}
+
+struct Level
+{
+	GLuint vao{};
+	GLuint instance_buffer{};
+	GLuint ground_texture{};
+	GLuint cube_texture{};
+	GLint model_location{};
+	GLsizei ground_index_count{};
+	GLsizei cube_first_index{};
+	GLsizei cube_index_count{};
+};
+
+//drawCube() for every cube, as draw_level() did before the instanced path. Returns the GL calls issued.
+static size_t drawPerObject(const Level& level, const std::vector<CubeInstance>& cubes)
+{
+	size_t calls = 0;
+	for (const CubeInstance& cube : cubes)
+	{
+		glm::mat4 model_view = glm::scale(glm::translate(glm::mat4(1.0f), cube.offset), cube.scale);
+		glUniformMatrix4fv(level.model_location, 1, GL_FALSE, &model_view[0][0]);
+		glBindTexture(GL_TEXTURE_2D, level.cube_texture);
+		glDrawElements(GL_TRIANGLE_STRIP, level.cube_index_count, GL_UNSIGNED_SHORT,
+			BUFFER_OFFSET(level.cube_first_index * sizeof(GLushort)));
+		calls += 3;
+	}
+	return calls;
+}
+
+//drawCubesInstanced(). Returns the GL calls issued.
+static size_t drawInstanced(const Level& level, const std::vector<CubeInstance>& cubes)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, level.instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, cubes.size() * sizeof(CubeInstance), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, cubes.size() * sizeof(CubeInstance), cubes.data());
+
+	glm::mat4 model_view(1.0f);
+	glUniformMatrix4fv(level.model_location, 1, GL_FALSE, &model_view[0][0]);
+	glBindTexture(GL_TEXTURE_2D, level.cube_texture);
+
+	glEnableVertexAttribArray(vInstanceOffset);
+	glEnableVertexAttribArray(vInstanceScale);
+	glDrawElementsInstanced(GL_TRIANGLE_STRIP, level.cube_index_count, GL_UNSIGNED_SHORT,
+		BUFFER_OFFSET(level.cube_first_index * sizeof(GLushort)), GLsizei(cubes.size()));
+	glDisableVertexAttribArray(vInstanceOffset);
+	glDisableVertexAttribArray(vInstanceScale);
+
+	glVertexAttrib3f(vInstanceOffset, 0.0f, 0.0f, 0.0f);
+	glVertexAttrib3f(vInstanceScale, 1.0f, 1.0f, 1.0f);
+	return 11;
+}
+
+struct Timing
+{
+	size_t calls{};
+	double submit_ms{};		//CPU time until the last call of the frame returned
+	double frame_ms{};		//Until glFinish() returned
+};
+
+template <typename Draw>
+static Timing run(const Level& level, const std::vector<CubeInstance>& cubes, int frames, Draw draw)
+{
+	static const glm::mat4 identity(1.0f);
+	Timing timing;
+	for (int f = 0; f < frames; f++)
+	{
+		Clock::time_point start = Clock::now();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glBindTexture(GL_TEXTURE_2D, level.ground_texture);
+		glDrawElements(GL_TRIANGLE_STRIP, level.ground_index_count, GL_UNSIGNED_SHORT, BUFFER_OFFSET(0));
+		timing.calls = 4 + draw(level, cubes);
+		glUniformMatrix4fv(level.model_location, 1, GL_FALSE, &identity[0][0]);	//As draw_level() leaves it
+		Clock::time_point submitted = Clock::now();
+		glFinish();
+		timing.submit_ms += std::chrono::duration<double, std::milli>(submitted - start).count();
+		timing.frame_ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+	timing.submit_ms /= frames;
+	timing.frame_ms /= frames;
+	return timing;
+}
+
+static std::vector<GLubyte> readImage(int width, int height)
+{
+	std::vector<GLubyte> pixels(size_t(width) * height * 4);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	return pixels;
+}
+
+int main(int argc, char** argv)
+{
+	size_t cube_count = 10000;
+	int frames = 50, width = 1024, height = 768;
+	std::string shaders = "../FirstExample";
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (std::strcmp(argv[i], "--cubes") == 0)
+			cube_count = std::strtoul(argv[i + 1], nullptr, 10);
+		else if (std::strcmp(argv[i], "--frames") == 0)
+			frames = std::max(1, std::atoi(argv[i + 1]));
+		else if (std::strcmp(argv[i], "--width") == 0)
+			width = std::max(1, std::atoi(argv[i + 1]));
+		else if (std::strcmp(argv[i], "--height") == 0)
+			height = std::max(1, std::atoi(argv[i + 1]));
+		else if (std::strcmp(argv[i], "--shaders") == 0)
+			shaders = argv[i + 1];
+	}
+
+	//A core context without a window: the image goes into a framebuffer object
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay display = get_platform_display ?
+		get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr) : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	EGLint major, minor;
+	const EGLint attributes[] = { EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+	EGLContext context = EGL_NO_CONTEXT;
+	if (eglInitialize(display, &major, &minor) && eglBindAPI(EGL_OPENGL_API))
+		context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		std::printf("No headless GL 4.3 core context (EGL error 0x%x)\n", unsigned(eglGetError()));
+		return 1;
+	}
+	std::printf("%s, %s\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+
+	GLuint framebuffer, renderbuffers[2];
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(2, renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+	glViewport(0, 0, width, height);
+
+	GLuint program = buildProgram(shaders);
+	if (!program)
+		return 1;
+	glUseProgram(program);
+
+	//The level the way init() sets it up
+	for (int v = 0; v < 28; v++)
+	{
+		static const GLfloat corners[4][2] = { { 0.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, 0.0f }, { 0.0f, 0.0f } };
+		GLfloat repeat = v < 4 ? 200.0f : 1.0f;
+		texture_coordinates[v][0] = v < 4 ? (v == 1 || v == 2 ? repeat : 0.0f) : corners[v % 4][0];
+		texture_coordinates[v][1] = v < 4 ? (v >= 2 ? repeat : 0.0f) : corners[v % 4][1];
+	}
+	std::vector<GLushort> indices;
+	quadStrips(0, 1, indices);
+	Level level;
+	level.ground_index_count = GLsizei(indices.size());
+	level.cube_first_index = GLsizei(indices.size() + 1);
+	indices.push_back(Restart_Index);
+	quadStrips(4, 6, indices);
+	level.cube_index_count = GLsizei(indices.size()) - level.cube_first_index;
+	glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+	glEnable(GL_DEPTH_TEST);
+
+	GLuint buffers[3];
+	glGenVertexArrays(1, &level.vao);
+	glBindVertexArray(level.vao);
+	glGenBuffers(3, buffers);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
+	glEnableVertexAttribArray(vPosition);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(texture_coordinates), texture_coordinates, GL_STATIC_DRAW);
+	glVertexAttribPointer(vTexCoord, 2, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
+	glEnableVertexAttribArray(vTexCoord);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &level.instance_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, level.instance_buffer);
+	glVertexAttribPointer(vInstanceOffset, 3, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), BUFFER_OFFSET(offsetof(CubeInstance, offset)));
+	glVertexAttribPointer(vInstanceScale, 3, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), BUFFER_OFFSET(offsetof(CubeInstance, scale)));
+	glVertexAttribDivisor(vInstanceOffset, 1);
+	glVertexAttribDivisor(vInstanceScale, 1);
+	glVertexAttrib3f(vInstanceOffset, 0.0f, 0.0f, 0.0f);
+	glVertexAttrib3f(vInstanceScale, 1.0f, 1.0f, 1.0f);
+
+	level.model_location = glGetUniformLocation(program, "model_matrix");
+	level.ground_texture = checkerTexture(60, 140);
+	level.cube_texture = checkerTexture(120, 230);
+
+	//Looking over the level from one edge, so nearly every cube is in view
+	glm::mat4 camera = glm::lookAt(glm::vec3(0.0f, -130.0f, 60.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), float(width) / float(height), 0.1f, 500.0f);
+	glm::mat4 identity(1.0f);
+	glUniformMatrix4fv(glGetUniformLocation(program, "camera_matrix"), 1, GL_FALSE, &camera[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(program, "projection_matrix"), 1, GL_FALSE, &projection[0][0]);
+	glUniformMatrix4fv(level.model_location, 1, GL_FALSE, &identity[0][0]);
+	glClearColor(0.5f, 0.7f, 1.0f, 1.0f);
+
+	//Obstacles and bullets: cubes of the sizes the game uses, spread over the level
+	std::mt19937 random(5);
+	std::uniform_real_distribution<float> spread(-95.0f, 95.0f), size(0.2f, 3.0f);
+	std::vector<CubeInstance> cubes(cube_count);
+	for (CubeInstance& cube : cubes)
+	{
+		float s = size(random);
+		cube = CubeInstance{ glm::vec3(spread(random), spread(random), 0.0f), glm::vec3(s, s, s) };
+	}
+
+	//One frame of each first: the images must match, and the driver gets to compile its shader variants
+	run(level, cubes, 1, drawPerObject);
+	std::vector<GLubyte> per_object_image = readImage(width, height);
+	run(level, cubes, 1, drawInstanced);
+	std::vector<GLubyte> instanced_image = readImage(width, height);
+	size_t different = 0;
+	for (size_t p = 0; p < per_object_image.size(); p += 4)
+		different += std::memcmp(&per_object_image[p], &instanced_image[p], 4) != 0;
+
+	Timing per_object = run(level, cubes, frames, drawPerObject);
+	Timing instanced = run(level, cubes, frames, drawInstanced);
+	GLenum error = glGetError();
+
+	std::printf("%zu cubes, %dx%d, %d frames each\n", cubes.size(), width, height, frames);
+	std::printf("per object: %7zu GL calls, %8.3f ms submitting, %8.3f ms per frame\n", per_object.calls,
+		per_object.submit_ms, per_object.frame_ms);
+	std::printf("instanced:  %7zu GL calls, %8.3f ms submitting, %8.3f ms per frame\n", instanced.calls,
+		instanced.submit_ms, instanced.frame_ms);
+	std::printf("%.1fx fewer calls, submitting %.1fx faster, frames %.2fx faster; %zu of %d pixels differ\n",
+		double(per_object.calls) / double(instanced.calls), per_object.submit_ms / instanced.submit_ms,
+		per_object.frame_ms / instanced.frame_ms, different, width * height);
+	if (error != GL_NO_ERROR)
+		std::printf("GL error 0x%x\n", unsigned(error));
+
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(display, context);
+	eglTerminate(display);
+	return different != 0 || error != GL_NO_ERROR ? 1 : 0;
+}
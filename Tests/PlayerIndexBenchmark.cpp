@@ -0,0 +1,143 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Benchmark for the remote player lookup (FirstExample/PlayerIndex.h). Fills a dense array of players the way
+// refresh_screen() does and times one update per player, in random order, through the index and through the old
+// std::find_if by name. Then lets players leave and join the way refresh_screen() handles them (erase() and a
+// swap-remove from the array) and times that too.
+// After every phase all ids, present and absent, are looked up and compared with a std::unordered_map.
+//
+//    PlayerIndexBenchmark [--players 10000] [--rounds 20] [--churn 100000]
+//
+// Prints the time per update and per leave and join. Exits with 1 when the index and the reference disagree.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../FirstExample/Player.h"
+#include "../FirstExample/PlayerIndex.h"
+
+using namespace sdds;
+
+typedef std::chrono::steady_clock Clock;
+
+//Same shape as RemotePlayer in RemotePlayers.h
+struct Remote
+{
+	uint32_t id{};
+	Player player{};
+};
+
+static bool sameAsReference(const PlayerIndex& index, const std::unordered_map<uint32_t, uint32_t>& reference,
+	const std::vector<Remote>& players, uint32_t max_id)
+{
+	if (index.size() != reference.size() || players.size() != reference.size())
+		return false;
+	for (uint32_t id = 0; id <= max_id; id++)
+	{
+		auto found = reference.find(id);
+		uint32_t slot = index.find(id);
+		if (found == reference.end() ? slot != PlayerIndex::Not_Found : slot != found->second || players[slot].id != id)
+			return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	size_t player_count = 10000, churn = 100000;
+	int rounds = 20;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (std::strcmp(argv[i], "--players") == 0)
+			player_count = std::max<size_t>(1, std::strtoul(argv[i + 1], nullptr, 10));
+		else if (std::strcmp(argv[i], "--rounds") == 0)
+			rounds = std::max(1, std::atoi(argv[i + 1]));
+		else if (std::strcmp(argv[i], "--churn") == 0)
+			churn = std::strtoul(argv[i + 1], nullptr, 10);
+	}
+
+	//Ids with gaps, like a server that has seen players come and go
+	std::mt19937 random(415);
+	std::vector<Remote> players;
+	std::unordered_map<uint32_t, uint32_t> reference;
+	PlayerIndex index;
+	uint32_t next_id = 1;
+	for (size_t i = 0; i < player_count; i++)
+	{
+		next_id += random() % 3;
+		Remote remote;
+		remote.id = next_id++;
+		remote.player.name = "player_" + std::to_string(remote.id);
+		index.insert(remote.id, uint32_t(players.size()));
+		reference[remote.id] = uint32_t(players.size());
+		players.push_back(remote);
+	}
+	bool failed = !sameAsReference(index, reference, players, next_id + 16);
+
+	std::vector<uint32_t> order(players.size());
+	for (uint32_t i = 0; i < order.size(); i++)
+		order[i] = i;
+
+	Clock::time_point start = Clock::now();
+	for (int r = 0; r < rounds; r++)
+	{
+		std::shuffle(order.begin(), order.end(), random);
+		for (uint32_t i : order)
+			players[index.find(players[i].id)].player.location.x += 1.0f;
+	}
+	double index_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (double(order.size()) * rounds);
+
+	//The old lookup is quadratic, so it gets a single round
+	std::vector<std::string> names(players.size());
+	for (size_t i = 0; i < players.size(); i++)
+		names[i] = players[i].player.name;
+	std::shuffle(order.begin(), order.end(), random);
+	start = Clock::now();
+	for (uint32_t i : order)
+		std::find_if(players.begin(), players.end(), [&](const Remote& p) { return p.player.name == names[i]; })->player.location.x += 1.0f;
+	double name_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / double(order.size());
+
+	std::printf("%zu players: index %.1f ns/update, find_if by name %.0f ns/update (%.0fx); all players %.3f ms vs %.1f ms\n",
+		players.size(), index_ns, name_ns, name_ns / index_ns, index_ns * players.size() / 1e6, name_ns * players.size() / 1e6);
+
+	//A random player leaves and a new one joins, so the count stays the same and erase() has to keep probe runs intact
+	start = Clock::now();
+	for (size_t c = 0; c < churn; c++)
+	{
+		uint32_t leaving = players[random() % players.size()].id;
+		uint32_t slot = index.erase(leaving);
+		if (slot != reference[leaving])
+		{
+			std::printf("erase(%u) returned slot %u instead of %u\n", leaving, slot, reference[leaving]);
+			return 1;
+		}
+		reference.erase(leaving);
+		if (slot != players.size() - 1)
+		{
+			players[slot] = std::move(players.back());
+			index.insert(players[slot].id, slot);
+			reference[players[slot].id] = slot;
+		}
+		players.pop_back();
+
+		Remote joining;
+		joining.id = next_id++;
+		index.insert(joining.id, uint32_t(players.size()));
+		reference[joining.id] = uint32_t(players.size());
+		players.push_back(std::move(joining));
+	}
+	double churn_ns = churn ? std::chrono::duration<double, std::nano>(Clock::now() - start).count() / double(churn) : 0.0;
+	bool same = sameAsReference(index, reference, players, next_id + 16);
+	std::printf("%zu leaves and joins: %.1f ns each (with the reference map), %s\n", churn, churn_ns,
+		same ? "same as the reference" : "DIFFERENT FROM THE REFERENCE");
+	failed = failed || !same;
+	return failed ? 1 : 0;
+}
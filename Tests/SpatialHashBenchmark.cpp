@@ -0,0 +1,121 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Benchmark for the collision broad phase (FirstExample/SpatialHash.h). Scatters objects over a square sized so
+// the density stays the same at every count, then runs ticks the way checkCollisions() does: every object moves,
+// is re-bucketed through update() and the candidate pairs are tested with the same overlap check as isColliding().
+// Up to --check objects, the hits are compared with the old all-pairs loop, and no pair may be reported twice.
+//
+//    SpatialHashBenchmark [--max 100000] [--ticks 10] [--check 10000]
+//
+// Prints the time per tick and per object for 1k, 10k, 100k ... objects up to --max. Near-linear scaling shows as
+// a flat time per object. Exits with 1 when the grid and the reference disagree.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+#include "../FirstExample/SpatialHash.h"
+
+using namespace sdds;
+
+typedef std::chrono::steady_clock Clock;
+
+//Same test as isColliding(): squares centered on the objects, collider_dimension is the half extent
+struct Objects
+{
+	std::vector<float> x{}, y{}, extent{};
+
+	bool overlap(uint32_t a, uint32_t b) const
+	{
+		float reach = extent[a] + extent[b];
+		return std::abs(x[a] - x[b]) <= reach && std::abs(y[a] - y[b]) <= reach;
+	}
+};
+
+//Every unordered overlapping pair, from the old nested loop (each pair once instead of twice)
+static std::set<std::pair<uint32_t, uint32_t>> bruteForce(const Objects& objects)
+{
+	std::set<std::pair<uint32_t, uint32_t>> hits;
+	uint32_t n = uint32_t(objects.x.size());
+	for (uint32_t a = 0; a < n; a++)
+		for (uint32_t b = a + 1; b < n; b++)
+			if (objects.overlap(a, b))
+				hits.insert({ a, b });
+	return hits;
+}
+
+int main(int argc, char** argv)
+{
+	size_t max_objects = 100000, check_up_to = 10000;
+	int ticks = 10;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (std::strcmp(argv[i], "--max") == 0)
+			max_objects = std::strtoul(argv[i + 1], nullptr, 10);
+		else if (std::strcmp(argv[i], "--ticks") == 0)
+			ticks = std::max(1, std::atoi(argv[i + 1]));
+		else if (std::strcmp(argv[i], "--check") == 0)
+			check_up_to = std::strtoul(argv[i + 1], nullptr, 10);
+	}
+
+	bool failed = false;
+	std::mt19937 random(415);
+	for (size_t n = 1000; n <= max_objects; n *= 10)
+	{
+		//Mostly bullet-sized objects with a large obstacle every 50, about 0.45 objects per unit square
+		Objects objects;
+		float side = std::sqrt(float(n)) * 1.5f;
+		std::uniform_real_distribution<float> position(0.0f, side);
+		for (size_t i = 0; i < n; i++)
+		{
+			objects.x.push_back(position(random));
+			objects.y.push_back(position(random));
+			objects.extent.push_back(i % 50 == 0 ? 2.0f : 0.1f);
+		}
+
+		SpatialHash grid(2.0f);
+		for (uint32_t i = 0; i < n; i++)
+			grid.update(i, objects.x[i], objects.y[i], objects.extent[i]);
+
+		unsigned long hits = 0;
+		Clock::time_point start = Clock::now();
+		for (int t = 0; t < ticks; t++)
+		{
+			for (uint32_t i = 0; i < n; i++)
+			{
+				objects.x[i] += 0.01f;
+				grid.update(i, objects.x[i], objects.y[i], objects.extent[i]);
+			}
+			grid.forEachCandidatePair([&](uint32_t a, uint32_t b) {
+				if (objects.overlap(a, b))
+					hits++;
+			});
+		}
+		double tick_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / ticks;
+		std::printf("%7zu objects: %8.3f ms/tick, %6.1f ns/object, %lu hits/tick\n", n, tick_ms, tick_ms * 1e6 / n,
+			hits / ticks);
+
+		if (n > check_up_to)
+			continue;
+		std::set<std::pair<uint32_t, uint32_t>> reference = bruteForce(objects), found;
+		bool duplicate = false;
+		grid.forEachCandidatePair([&](uint32_t a, uint32_t b) {
+			std::pair<uint32_t, uint32_t> pair(std::min(a, b), std::max(a, b));
+			if (objects.overlap(a, b) && !found.insert(pair).second)
+				duplicate = true;
+		});
+		bool same = found == reference;
+		std::printf("%7s brute force: %zu hits, grid: %zu hits, %s%s\n", "", reference.size(), found.size(),
+			same ? "same pairs" : "DIFFERENT PAIRS", duplicate ? ", DUPLICATE PAIRS" : "");
+		failed = failed || !same || duplicate;
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,342 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Round-trip fuzz test for the frames the client and the server exchange (FirstExample/WireFormat.h,
+// PlayerSerializer.h and DeltaCodec.h). Build it with -fsanitize=address,undefined to also catch decoders reading
+// past their input.
+//
+//    WireFormatFuzz [--iterations 200000] [--seed 415]
+//
+// Every iteration:
+//  - encodes a random player (any name bytes, usually up to 40 of them, sometimes longer than wire::Max_Name_Length;
+//    locations inside and far outside the level, NaN) and decodes it again: same name (cut to the maximum length),
+//    location within half a quantum (or clamped)
+//  - decodes every truncation of the record, which must all fail
+//  - decodes random garbage as a player, as Msg_Positions and as Msg_Delta, which may fail but must not crash
+// Every 100 iterations the locations of up to 12000 players (so they split over several frames) are encoded as
+// Msg_Positions and fed through a FrameReader in random chunk sizes; every player must come back once, in order.
+// Every 100 iterations a stream of 200 delta snapshots goes from a DeltaEncoder to a DeltaDecoder, with players
+// moving between a few locations, joining and leaving, a quarter of the frames lost and acks arriving late. The
+// world as the client learns it from on_player and on_leave must be the server's world after every frame.
+// Before all that, the case of a player that returns to its baseline location before the ack arrives, and a record
+// whose name is longer than the maximum, which must not decode.
+//
+// Prints the failures and exits with 1 if there were any.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "../FirstExample/DeltaCodec.h"
+#include "../FirstExample/Player.h"
+#include "../FirstExample/PlayerSerializer.h"
+#include "../FirstExample/WireFormat.h"
+
+using namespace sdds;
+
+static std::mt19937 random_engine;
+static unsigned long failures = 0;
+
+static void fail(const char* what, unsigned long iteration)
+{
+	if (failures++ < 20)
+		std::printf("iteration %lu: %s\n", iteration, what);
+}
+
+static uint32_t below(uint32_t n)
+{
+	return std::uniform_int_distribution<uint32_t>(0, n - 1)(random_engine);
+}
+
+static float randomCoordinate()
+{
+	switch (below(20))
+	{
+	case 0: return std::numeric_limits<float>::quiet_NaN();
+	case 1: return (below(2) ? 1 : -1) * std::ldexp(1.0f + below(1000) / 1000.0f, int(below(120)));	//Up to 2^120
+	default: return std::uniform_real_distribution<float>(-200.0f, 200.0f)(random_engine);
+	}
+}
+
+static Player randomPlayer(size_t max_name)
+{
+	Player player;
+	size_t length = below(uint32_t(max_name + 1));
+	for (size_t i = 0; i < length; i++)
+		player.name.push_back(char(below(256)));
+	player.location = Location{ randomCoordinate(), randomCoordinate(), randomCoordinate() };
+	return player;
+}
+
+//What the receiver should see for a coordinate that went through the wire. Below 2^16 floats are finer than the
+//quantum, so the value arrives within half a quantum; beyond that only the quantized value itself can be checked.
+static bool sameCoordinate(float sent, float received)
+{
+	return received == wire::dequantize(wire::quantize(sent))
+		&& (!(std::abs(sent) < 65536.0f) || std::abs(received - sent) <= wire::Location_Quantum / 2);
+}
+
+static bool samePlayer(const Player& sent, const PlayerView& received)
+{
+	return received.nameEquals(sent.name.substr(0, wire::Max_Name_Length))
+		&& sameCoordinate(sent.location.x, received.location.x)
+		&& sameCoordinate(sent.location.y, received.location.y)
+		&& sameCoordinate(sent.location.z, received.location.z);
+}
+
+static void playerRoundTrip(unsigned long iteration)
+{
+	Player sent = randomPlayer(below(50) == 0 ? 2 * wire::Max_Name_Length : 40);
+	SerializedPlayer frame = SerializedPlayer::player_serializer(sent);
+
+	wire::FrameHeader header;
+	if (!wire::getFrameHeader(frame.data.data(), frame.size, header) || header.type != wire::Msg_Player
+		|| header.version != wire::Protocol_Version || wire::Frame_Header_Size + header.length != size_t(frame.size))
+	{
+		fail("bad Msg_Player frame header", iteration);
+		return;
+	}
+
+	const char* payload = frame.data.data() + wire::Frame_Header_Size;
+	const char* cursor = payload;
+	PlayerView view;
+	if (!SerializedPlayer::decode(cursor, payload + header.length, view) || cursor != payload + header.length)
+		fail("player record does not decode", iteration);
+	else if (!samePlayer(sent, view))
+		fail("player record decodes to something else", iteration);
+
+	Player owning;
+	if (!SerializedPlayer::player_deserializer(payload, header.length, owning)
+		|| owning.name != sent.name.substr(0, wire::Max_Name_Length))
+		fail("player_deserializer lost the name", iteration);
+
+	//The truncated copies go into exactly sized heap buffers, so reading one byte too far trips ASan
+	for (size_t length = 0; length < header.length; length++)
+	{
+		std::vector<char> truncated(payload, payload + length);
+		Player player;
+		if (SerializedPlayer::player_deserializer(truncated.data(), truncated.size(), player))
+			fail("truncated player record decodes", iteration);
+	}
+}
+
+static void garbage(unsigned long iteration)
+{
+	std::vector<char> bytes(below(48));
+	for (char& byte : bytes)
+		byte = char(below(256));
+	Player player;
+	SerializedPlayer::player_deserializer(bytes.data(), bytes.size(), player);
+	static DeltaDecoder decoder;	//Garbage that happens to decode becomes the baseline of later garbage
+	unsigned long seen = 0;
+	wire::getPositions(bytes.data(), bytes.size(), [&seen](const QuantizedPlayer&) { seen++; });
+	decoder.decode(bytes.data(), bytes.size(), [&seen](const PlayerView&) { seen++; }, [&seen](uint32_t) { seen++; });
+	wire::FrameHeader header;
+	if (wire::getFrameHeader(bytes.data(), bytes.size(), header) != (bytes.size() >= wire::Frame_Header_Size))
+		fail("frame header of garbage", iteration);
+}
+
+static void oversizedName()
+{
+	std::vector<char> record(wire::Max_Varint_Size + wire::Max_Name_Length + 1 + 3, 'a');
+	size_t at = wire::putVarint(record.data(), wire::Max_Name_Length + 1);
+	record.resize(at + wire::Max_Name_Length + 1 + 3);
+	record[record.size() - 1] = record[record.size() - 2] = record[record.size() - 3] = 0;
+	Player player;
+	if (SerializedPlayer::player_deserializer(record.data(), record.size(), player))
+		fail("player record with a name longer than the maximum decodes", 0);
+}
+
+static int32_t randomQuantized()
+{
+	switch (below(10))
+	{
+	case 0: return std::numeric_limits<int32_t>::min() + int32_t(below(4));
+	case 1: return std::numeric_limits<int32_t>::max() - int32_t(below(4));
+	default: return int32_t(below(25601)) - 12800;	//Inside the level
+	}
+}
+
+static void positionsRoundTrip(unsigned long iteration)
+{
+	std::vector<QuantizedPlayer> sent(below(12000));
+	uint32_t id = 0;
+	for (QuantizedPlayer& p : sent)
+	{
+		id += 1 + (below(4) == 0 ? below(100000) : 0);
+		p = QuantizedPlayer{ id, randomQuantized(), randomQuantized(), randomQuantized() };
+	}
+	std::vector<char> stream;
+	wire::putPositions(stream, sent.data(), sent.size());
+
+	wire::FrameReader reader(16);
+	size_t offset = 0, received = 0;
+	bool ok = true;
+	while (ok && offset < stream.size())
+	{
+		size_t available;
+		char* into = reader.space(available);
+		size_t chunk = std::min(std::min(available, stream.size() - offset), size_t(1 + below(3000)));
+		std::memcpy(into, stream.data() + offset, chunk);
+		reader.commit(chunk);
+		offset += chunk;
+
+		wire::FrameHeader header;
+		const char* payload;
+		while (ok && reader.next(header, payload))
+		{
+			ok = header.type == wire::Msg_Positions
+				&& wire::getPositions(payload, header.length, [&](const QuantizedPlayer& p) {
+					if (received >= sent.size() || p.id != sent[received].id || p.x != sent[received].x
+						|| p.y != sent[received].y || p.z != sent[received].z)
+						ok = false;
+					received++;
+				});
+		}
+	}
+	if (!ok || received != sent.size() || offset != stream.size())
+		fail("Msg_Positions do not come back in order", iteration);
+}
+
+//The world as a client sees it, built only from what DeltaDecoder::decode() reports
+typedef std::map<uint32_t, Location> View;
+
+static bool decodeInto(DeltaDecoder& decoder, const std::vector<char>& frame, View& view)
+{
+	wire::FrameHeader header;
+	if (!wire::getFrameHeader(frame.data(), frame.size(), header) || header.type != wire::Msg_Delta
+		|| wire::Frame_Header_Size + header.length != frame.size())
+		return false;
+	return decoder.decode(frame.data() + wire::Frame_Header_Size, header.length,
+		[&view](const PlayerView& player) { view[player.id] = player.location; },
+		[&view](uint32_t id) { view.erase(id); });
+}
+
+static bool sameWorld(const View& view, const std::vector<QuantizedPlayer>& world)
+{
+	if (view.size() != world.size())
+		return false;
+	for (const QuantizedPlayer& p : world)
+	{
+		auto found = view.find(p.id);
+		Location at = p.location();
+		if (found == view.end() || found->second.x != at.x || found->second.y != at.y || found->second.z != at.z)
+			return false;
+	}
+	return true;
+}
+
+//S1 (x = 0) is acknowledged, S2 (x = 1) is decoded but not acknowledged yet, S3 (x = 0) is encoded against S1 and
+//so leaves the player out. The client was told x = 1 and must be told x = 0 again.
+static void deltaReturnToBaseline()
+{
+	DeltaEncoder encoder;
+	DeltaDecoder decoder;
+	View view;
+	std::string name = "Yousef";
+	auto name_of = [&name](uint32_t) { return &name; };
+	std::vector<char> frame;
+	const QuantizedPlayer states[3] = { { 1, 0, 0, 0 }, { 1, wire::quantize(1.0f), 0, 0 }, { 1, 0, 0, 0 } };
+	for (int s = 0; s < 3; s++)
+	{
+		frame.clear();
+		if (!encoder.encode(&states[s], 1, name_of, frame) || !decodeInto(decoder, frame, view))
+			fail("delta does not decode", 0);
+		if (s == 0)
+			encoder.acknowledge(decoder.latestSequence());
+		if (!sameWorld(view, std::vector<QuantizedPlayer>(1, states[s])))
+			fail("player back at its baseline location is not reported", 0);
+	}
+}
+
+static void deltaStream(unsigned long iteration)
+{
+	DeltaEncoder encoder;
+	DeltaDecoder decoder;
+	View view;
+	std::string name = "Yousef";
+	auto name_of = [&name](uint32_t) { return &name; };
+	std::vector<QuantizedPlayer> world;
+	std::deque<uint32_t> acks;	//On their way to the server
+	std::vector<char> frame;
+	uint32_t next_id = 1;
+	for (int step = 0; step < 200; step++)
+	{
+		//Few distinct coordinates, so players often return to where their baseline has them
+		for (size_t i = 0; i < world.size(); i++)
+		{
+			if (below(20) == 0)
+				world.erase(world.begin() + i--);
+			else if (below(3) == 0)
+				world[i].x = int32_t(below(3)) - 1, world[i].z = int32_t(below(2));
+		}
+		for (uint32_t joining = below(3) == 0 ? below(4) : 0; joining > 0; joining--)
+			world.push_back(QuantizedPlayer{ next_id++, int32_t(below(3)), 0, 0 });
+
+		frame.clear();
+		if (!encoder.encode(world.data(), world.size(), name_of, frame))
+		{
+			fail("delta does not fit", iteration);
+			return;
+		}
+		if (below(4) == 0)
+			continue;	//Lost
+		if (!decodeInto(decoder, frame, view))
+		{
+			fail("delta stream does not decode", iteration);
+			return;
+		}
+		if (!sameWorld(view, world))
+		{
+			fail("client's world differs from the server's after a delta", iteration);
+			return;
+		}
+		acks.push_back(decoder.latestSequence());
+		while (!acks.empty() && below(3) == 0)
+		{
+			if (below(5) != 0)
+				encoder.acknowledge(acks.front());
+			acks.pop_front();
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long iterations = 200000, seed = 415;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (std::strcmp(argv[i], "--iterations") == 0)
+			iterations = std::strtoul(argv[i + 1], nullptr, 10);
+		else if (std::strcmp(argv[i], "--seed") == 0)
+			seed = std::strtoul(argv[i + 1], nullptr, 10);
+	}
+	random_engine.seed(uint32_t(seed));
+
+	deltaReturnToBaseline();
+	oversizedName();
+
+	for (unsigned long i = 0; i < iterations; i++)
+	{
+		playerRoundTrip(i);
+		garbage(i);
+		if (i % 100 == 0)
+		{
+			positionsRoundTrip(i);
+			deltaStream(i);
+		}
+	}
+
+	Player example(Location{ 12.3f, -45.6f, 0.8f }, "Yousef");
+	std::printf("%lu iterations, %lu failures. \"Yousef\" at (12.3, -45.6, 0.8): %d bytes framed, sizeof(Player) %zu\n",
+		iterations, failures, SerializedPlayer::player_serializer(example).size, sizeof(Player));
+	return failures ? 1 : 0;
+}